@@ -35,6 +35,7 @@ Run-WSL "gcc -m32 -c src/arch/x86/boot.s -o build/boot.o"
 Write-Host "Compiling kernel..." -ForegroundColor Yellow
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/kernel/kernel.c -o build/kernel.o"
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/kernel/idt.c -o build/idt.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/kernel/cpu.c -o build/cpu.o"
 
 # Compile drivers
 Write-Host "Compiling drivers..." -ForegroundColor Yellow
@@ -42,21 +43,43 @@ Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c s
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/keyboard/keyboard.c -o build/drivers/keyboard.o"
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/shell/shell.c -o build/drivers/shell.o"
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/timer/timer.c -o build/drivers/timer.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/block/blockdev.c -o build/drivers/blockdev.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/block/bcache.c -o build/drivers/bcache.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/ata/ata.c -o build/drivers/ata.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/pci/pci.c -o build/drivers/pci.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/virtio/virtio.c -o build/drivers/virtio.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/drivers/virtio/virtio_blk.c -o build/drivers/virtio_blk.o"
 
 # Compile memory management
 Write-Host "Compiling memory management..." -ForegroundColor Yellow
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/memory.c -o build/mm/memory.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/pmm.c -o build/mm/pmm.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/paging.c -o build/mm/paging.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/slab.c -o build/mm/slab.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/arena.c -o build/mm/arena.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/zram.c -o build/mm/zram.o"
 
 # Compile library functions
 Write-Host "Compiling libraries..." -ForegroundColor Yellow
 Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/lib/filesystem.c -o build/filesystem.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/lib/string.c -o build/string.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/lib/lz4.c -o build/lz4.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/lib/initrd.c -o build/initrd.o"
 
 # Compile interrupt handlers
 Run-WSL "gcc -m32 -c src/arch/x86/keyboard_entry.s -o build/arch/keyboard_entry.o"
 Run-WSL "gcc -m32 -c src/arch/x86/timer_entry.s -o build/arch/timer_entry.o"
+Run-WSL "gcc -m32 -c src/arch/x86/page_fault_entry.s -o build/arch/page_fault_entry.o"
+Run-WSL "gcc -m32 -c src/arch/x86/ata_entry.s -o build/arch/ata_entry.o"
+Run-WSL "gcc -m32 -c src/arch/x86/virtio_entry.s -o build/arch/virtio_entry.o"
 
 Write-Host "Linking kernel..." -ForegroundColor Yellow
-Run-WSL "ld -m elf_i386 -T src/kernel/linker.ld -o isodir/boot/kernel.bin build/multiboot.o build/boot.o build/kernel.o build/idt.o build/arch/keyboard_entry.o build/arch/timer_entry.o build/drivers/screen.o build/drivers/keyboard.o build/drivers/shell.o build/drivers/timer.o build/mm/memory.o build/filesystem.o"
+Run-WSL "ld -m elf_i386 -T src/kernel/linker.ld -o isodir/boot/kernel.bin build/multiboot.o build/boot.o build/kernel.o build/idt.o build/cpu.o build/arch/keyboard_entry.o build/arch/timer_entry.o build/arch/page_fault_entry.o build/arch/ata_entry.o build/arch/virtio_entry.o build/drivers/screen.o build/drivers/keyboard.o build/drivers/shell.o build/drivers/timer.o build/drivers/blockdev.o build/drivers/bcache.o build/drivers/ata.o build/drivers/pci.o build/drivers/virtio.o build/drivers/virtio_blk.o build/mm/memory.o build/mm/pmm.o build/mm/paging.o build/mm/slab.o build/mm/arena.o build/mm/zram.o build/filesystem.o build/initrd.o build/string.o build/lz4.o"
+
+# Pack the initrd/ directory into the image GRUB loads as a module
+Write-Host "Packing initrd..." -ForegroundColor Yellow
+Run-WSL "gcc -std=gnu99 -O2 -Wall -Wextra tools/mkinitrd/mkinitrd.c -o build/mkinitrd"
+Run-WSL "build/mkinitrd initrd isodir/boot/initrd.img"
 
 # Create GRUB config
 Write-Host "Creating GRUB config..." -ForegroundColor Yellow
@@ -66,6 +89,7 @@ set default=0
 
 menuentry "TRAK-OS" {
     multiboot /boot/kernel.bin
+    module /boot/initrd.img
     boot
 }
 "@ | Out-File -FilePath "isodir/boot/grub/grub.cfg" -Encoding ASCII
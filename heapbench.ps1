@@ -0,0 +1,30 @@
+# TRAK-OS Heap Benchmark
+# Builds src/mm/memory.c as a Linux program and replays allocation traces
+# Usage: .\heapbench.ps1 [-n ops] [-s seed] [-m arena_mb] [-w out.trace] [-v] [shell|fs|random|all|file...]
+
+Write-Host "Building heap benchmark..." -ForegroundColor Green
+
+$ErrorActionPreference = "Stop"
+
+function Run-WSL {
+    param([string]$Command)
+    Write-Host "Running: $Command" -ForegroundColor Blue
+    wsl bash -c "$Command"
+    if ($LASTEXITCODE -ne 0) {
+        Write-Host "Heap benchmark failed!" -ForegroundColor Red
+        exit 1
+    }
+}
+
+New-Item -ItemType Directory -Force build/heapbench | Out-Null
+
+# The allocator and its glue see only the kernel headers; the driver sees only libc.
+# Everything is 32-bit because the heap keeps addresses in 32-bit fields.
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -Itools/heapbench -c src/mm/memory.c -o build/heapbench/memory.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -c src/mm/pmm.c -o build/heapbench/pmm.o"
+Run-WSL "gcc -m32 -std=gnu99 -ffreestanding -O2 -Wall -Wextra -Isrc/include -Itools/heapbench -c tools/heapbench/kernel_glue.c -o build/heapbench/kernel_glue.o"
+Run-WSL "gcc -m32 -std=gnu99 -O2 -Wall -Wextra -c tools/heapbench/heapbench.c -o build/heapbench/heapbench.o"
+Run-WSL "gcc -m32 -o build/heapbench/heapbench build/heapbench/heapbench.o build/heapbench/kernel_glue.o build/heapbench/memory.o build/heapbench/pmm.o"
+
+Write-Host ""
+Run-WSL "build/heapbench/heapbench $args"
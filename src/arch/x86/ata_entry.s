@@ -0,0 +1,75 @@
+.section .note.GNU-stack,"",@progbits
+
+.section .text
+
+# IRQ14/IRQ15 (primary/secondary IDE channel) interrupt handlers. Both
+# lines sit on the slave PIC, so both PICs need an EOI.
+.global irq14_handler
+.type irq14_handler, @function
+irq14_handler:
+    pushf
+    pusha
+    
+    push %ds
+    push %es
+    push %fs
+    push %gs
+    
+    mov $0x10, %ax
+    mov %ax, %ds
+    mov %ax, %es
+    
+    # ata_irq_handler(0)
+    push $0
+    call ata_irq_handler
+    add $4, %esp
+    
+    mov $0x20, %al
+    out %al, $0xA0
+    out %al, $0x20
+    
+    pop %gs
+    pop %fs
+    pop %es
+    pop %ds
+    
+    popa
+    popf
+    iret
+
+.size irq14_handler, . - irq14_handler
+
+.global irq15_handler
+.type irq15_handler, @function
+irq15_handler:
+    pushf
+    pusha
+    
+    push %ds
+    push %es
+    push %fs
+    push %gs
+    
+    mov $0x10, %ax
+    mov %ax, %ds
+    mov %ax, %es
+    
+    # ata_irq_handler(1)
+    push $1
+    call ata_irq_handler
+    add $4, %esp
+    
+    mov $0x20, %al
+    out %al, $0xA0
+    out %al, $0x20
+    
+    pop %gs
+    pop %fs
+    pop %es
+    pop %ds
+    
+    popa
+    popf
+    iret
+
+.size irq15_handler, . - irq15_handler
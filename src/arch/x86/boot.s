@@ -20,6 +20,10 @@ _start:
     # Disable interrupts until we set up IDT
     cli
     
+    # Pass the multiboot info pointer (EBX) and magic (EAX) to the kernel
+    push %ebx
+    push %eax
+    
     # Call the kernel main function
     call kernel_main
     
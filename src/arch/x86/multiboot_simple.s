@@ -2,7 +2,9 @@
 
 # Multiboot specification constants
 .set MULTIBOOT_MAGIC,       0x1BADB002
-.set MULTIBOOT_FLAGS,       0x00000000  # No flags - simplest possible
+.set MULTIBOOT_PAGE_ALIGN,  0x00000001  # Load modules on page boundaries
+.set MULTIBOOT_MEMORY_INFO, 0x00000002  # Ask for mem_* fields and the memory map
+.set MULTIBOOT_FLAGS,       MULTIBOOT_PAGE_ALIGN | MULTIBOOT_MEMORY_INFO
 .set MULTIBOOT_CHECKSUM,    -(MULTIBOOT_MAGIC + MULTIBOOT_FLAGS)
 
 # Multiboot header - MUST be in first 8KB of kernel
@@ -0,0 +1,43 @@
+.section .note.GNU-stack,"",@progbits
+
+.section .text
+
+# Exception 14 (Page Fault) handler
+# The CPU pushes an error code and leaves the faulting address in CR2
+.global isr14_handler
+.type isr14_handler, @function
+isr14_handler:
+    # Save all general registers
+    pusha
+    
+    # Save segment registers
+    push %ds
+    push %es
+    push %fs
+    push %gs
+    
+    # Set up kernel data segments
+    mov $0x10, %ax
+    mov %ax, %ds
+    mov %ax, %es
+    
+    # paging_fault_handler(error, address, eip)
+    push 52(%esp)            # Faulting EIP
+    mov %cr2, %eax
+    push %eax                # Faulting address
+    push 56(%esp)            # Error code
+    call paging_fault_handler
+    add $12, %esp
+    
+    # Restore segment registers
+    pop %gs
+    pop %fs
+    pop %es
+    pop %ds
+    
+    # Restore all registers, drop the error code
+    popa
+    add $4, %esp
+    iret
+
+.size isr14_handler, . - isr14_handler
@@ -0,0 +1,38 @@
+.section .note.GNU-stack,"",@progbits
+
+.section .text
+
+# virtio PCI interrupt handler. The line is whatever the firmware routed
+# the device to; the driver only installs this for IRQ 9-11, which sit on
+# the slave PIC, so both PICs need an EOI.
+.global virtio_irq_handler
+.type virtio_irq_handler, @function
+virtio_irq_handler:
+    pushf
+    pusha
+    
+    push %ds
+    push %es
+    push %fs
+    push %gs
+    
+    mov $0x10, %ax
+    mov %ax, %ds
+    mov %ax, %es
+    
+    call virtio_blk_irq_handler
+    
+    mov $0x20, %al
+    out %al, $0xA0
+    out %al, $0x20
+    
+    pop %gs
+    pop %fs
+    pop %es
+    pop %ds
+    
+    popa
+    popf
+    iret
+
+.size virtio_irq_handler, . - virtio_irq_handler
@@ -0,0 +1,542 @@
+#include "../include/ata.h"
+#include "../include/io.h"
+#include "../include/pci.h"
+#include "../include/pmm.h"
+#include "../include/paging.h"
+#include "../include/memory.h"
+#include "../include/timer.h"
+#include "../include/cpu.h"
+#include "../include/screen.h"
+
+// Up to two drives on each of the two legacy channels
+static ata_drive_t drives[4];
+static uint32_t drive_count = 0;
+
+// One PRDT per channel. Aligning it to its own size keeps it inside a
+// 64KB window, as the controller requires.
+static ata_prd_t prd_tables[2][ATA_PRD_ENTRIES] __attribute__((aligned(ATA_PRD_ENTRIES * sizeof(ata_prd_t))));
+static const uint16_t channel_io[2] = { ATA_PRIMARY_IO, ATA_SECONDARY_IO };
+static volatile uint32_t channel_irqs[2];
+static bool dma_enabled = true;      // Cleared by the benchmark to time PIO
+static uint16_t bmide_base = 0;      // Bus-master registers of the PCI IDE function
+
+// Cycles the CPU was free while DMA transfers ran
+static uint64_t dma_wait_cycles = 0;
+
+static void print_number(uint32_t num);
+static void print_column(uint32_t num, const char* suffix, uint32_t width);
+
+// Reading the alternate status register four times takes the 400ns a
+// drive needs to put up valid status after a select or command
+static void ata_delay(ata_drive_t* drive) {
+    for (int i = 0; i < 4; i++) {
+        inb(drive->ctrl);
+    }
+}
+
+// Wait for BSY to clear, and for DRQ too when data is expected. Returns
+// -1 if the drive reports an error or never becomes ready.
+static int ata_wait(ata_drive_t* drive, bool need_drq) {
+    for (uint32_t i = 0; i < ATA_TIMEOUT; i++) {
+        uint8_t status = inb(drive->io + ATA_REG_STATUS);
+        if (status & ATA_SR_BSY) {
+            continue;
+        }
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return -1;
+        }
+        if (!need_drq || (status & ATA_SR_DRQ)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Select the drive and load an LBA28 address and sector count
+static void ata_setup(ata_drive_t* drive, uint32_t lba, uint32_t count) {
+    outb(drive->io + ATA_REG_DRIVE, 0xE0 | (drive->slave << 4) | ((lba >> 24) & 0x0F));
+    ata_delay(drive);
+    outb(drive->io + ATA_REG_SECCOUNT, count == ATA_MAX_SECTORS ? 0 : count);
+    outb(drive->io + ATA_REG_LBA0, lba & 0xFF);
+    outb(drive->io + ATA_REG_LBA1, (lba >> 8) & 0xFF);
+    outb(drive->io + ATA_REG_LBA2, (lba >> 16) & 0xFF);
+}
+
+// Transfer up to ATA_MAX_SECTORS sectors a word at a time through the data port
+static int ata_pio_read(ata_drive_t* drive, uint32_t lba, uint32_t count, uint8_t* out) {
+    if (ata_wait(drive, false) < 0) {
+        return -1;
+    }
+    ata_setup(drive, lba, count);
+    outb(drive->io + ATA_REG_COMMAND, ATA_CMD_READ_PIO);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        ata_delay(drive);
+        if (ata_wait(drive, true) < 0) {
+            return -1;
+        }
+        insw(drive->io + ATA_REG_DATA, out, BLOCK_SECTOR_SIZE / 2);
+        out += BLOCK_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+static int ata_pio_write(ata_drive_t* drive, uint32_t lba, uint32_t count, const uint8_t* in) {
+    if (ata_wait(drive, false) < 0) {
+        return -1;
+    }
+    ata_setup(drive, lba, count);
+    outb(drive->io + ATA_REG_COMMAND, ATA_CMD_WRITE_PIO);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        ata_delay(drive);
+        if (ata_wait(drive, true) < 0) {
+            return -1;
+        }
+        
+        // One word at a time; some drives cannot keep up with rep outsw
+        const uint16_t* words = (const uint16_t*)in;
+        for (uint32_t w = 0; w < BLOCK_SECTOR_SIZE / 2; w++) {
+            outw(drive->io + ATA_REG_DATA, words[w]);
+        }
+        in += BLOCK_SECTOR_SIZE;
+    }
+    ata_delay(drive);
+    return ata_wait(drive, false);
+}
+
+// Describe a buffer to the controller page by page, merging pages that
+// are physically adjacent. Returns false if the buffer cannot be used.
+static bool ata_build_prdt(ata_prd_t* table, uint32_t virt, uint32_t bytes) {
+    if (virt & 1) {
+        return false; // The controller moves whole words
+    }
+    
+    int n = -1;
+    uint32_t length = 0; // Of entry n
+    while (bytes > 0) {
+        uint32_t phys = paging_get_physical(virt);
+        if (!phys) {
+            return false;
+        }
+        uint32_t chunk = FRAME_SIZE - (virt & (FRAME_SIZE - 1));
+        if (chunk > bytes) {
+            chunk = bytes;
+        }
+        
+        if (n >= 0 && table[n].address + length == phys &&
+            (table[n].address >> 16) == ((phys + chunk - 1) >> 16)) {
+            length += chunk;
+        } else {
+            if (++n == ATA_PRD_ENTRIES) {
+                return false;
+            }
+            table[n].address = phys;
+            table[n].flags = 0;
+            length = chunk;
+        }
+        table[n].bytes = (uint16_t)length; // 64KB wraps to 0, which means 64KB
+        virt += chunk;
+        bytes -= chunk;
+    }
+    table[n].flags = ATA_PRD_EOT;
+    return true;
+}
+
+// Wait for something to happen while a DMA transfer runs: the allocator's
+// idle work if it has any, otherwise halt until the next interrupt. The
+// halt needs interrupts on and is skipped if the drive already signalled.
+static void ata_dma_pause(ata_drive_t* drive, uint32_t irqs) {
+    if (memory_idle()) {
+        return;
+    }
+    uint32_t flags;
+    asm volatile ("pushf; pop %0" : "=r"(flags));
+    if (flags & 0x200) {
+        asm volatile ("cli");
+        if (channel_irqs[drive->channel] == irqs) {
+            asm volatile ("sti; hlt");
+        } else {
+            asm volatile ("sti");
+        }
+    }
+}
+
+// Move up to ATA_DMA_MAX_SECTORS sectors by bus-master DMA. Returns 0, -1
+// on a device error and 1 if the buffer cannot be described to the
+// controller, in which case the caller falls back to PIO.
+static int ata_dma_transfer(ata_drive_t* drive, uint32_t lba, uint32_t count, void* buffer, bool write) {
+    ata_prd_t* table = prd_tables[drive->channel];
+    if (!ata_build_prdt(table, (uint32_t)buffer, count * BLOCK_SECTOR_SIZE)) {
+        return 1;
+    }
+    if (ata_wait(drive, false) < 0) {
+        return -1;
+    }
+    
+    // Status bits 5 and 6 record which drives can do DMA; keep them while
+    // clearing the error and interrupt bits
+    uint16_t bm = drive->bmide;
+    outb(bm + ATA_BM_COMMAND, 0);
+    outl(bm + ATA_BM_PRDT, paging_get_physical((uint32_t)table));
+    outb(bm + ATA_BM_STATUS, inb(bm + ATA_BM_STATUS) | ATA_BM_SR_IRQ | ATA_BM_SR_ERR);
+    
+    uint32_t irqs = channel_irqs[drive->channel];
+    ata_setup(drive, lba, count);
+    outb(drive->io + ATA_REG_COMMAND, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+    outb(bm + ATA_BM_COMMAND, (write ? 0 : ATA_BM_CMD_READ) | ATA_BM_CMD_START);
+    
+    // The transfer needs nothing more from the CPU until the drive interrupts
+    uint64_t start = rdtsc();
+    uint64_t timeout = (uint64_t)ATA_DMA_TIMEOUT_MS * timer_tsc_per_ms();
+    uint8_t status;
+    bool timed_out = false;
+    while (!((status = inb(bm + ATA_BM_STATUS)) & (ATA_BM_SR_IRQ | ATA_BM_SR_ERR))) {
+        if (rdtsc() - start > timeout) {
+            timed_out = true;
+            break;
+        }
+        ata_dma_pause(drive, irqs);
+    }
+    dma_wait_cycles += rdtsc() - start;
+    
+    outb(bm + ATA_BM_COMMAND, 0);
+    outb(bm + ATA_BM_STATUS, status | ATA_BM_SR_IRQ | ATA_BM_SR_ERR);
+    uint8_t drive_status = inb(drive->io + ATA_REG_STATUS); // Also acknowledges the interrupt
+    if (timed_out || (status & ATA_BM_SR_ERR) || (drive_status & (ATA_SR_ERR | ATA_SR_DF))) {
+        return -1;
+    }
+    return 0;
+}
+
+// Commands go by DMA when the controller supports it, in 64KB pieces,
+// and by PIO otherwise or for buffers DMA cannot reach
+static int ata_read(block_device_t* dev, uint32_t lba, uint32_t count, void* buffer) {
+    ata_drive_t* drive = dev->driver_data;
+    uint8_t* out = buffer;
+    
+    while (count > 0) {
+        uint32_t chunk = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        int result = 1;
+        if (drive->bmide && dma_enabled) {
+            chunk = chunk < ATA_DMA_MAX_SECTORS ? chunk : ATA_DMA_MAX_SECTORS;
+            result = ata_dma_transfer(drive, lba, chunk, out, false);
+        }
+        if (result > 0) {
+            result = ata_pio_read(drive, lba, chunk, out);
+        }
+        if (result < 0) {
+            return -1;
+        }
+        out += chunk * BLOCK_SECTOR_SIZE;
+        lba += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+static int ata_write(block_device_t* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    ata_drive_t* drive = dev->driver_data;
+    const uint8_t* in = buffer;
+    
+    while (count > 0) {
+        uint32_t chunk = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        int result = 1;
+        if (drive->bmide && dma_enabled) {
+            chunk = chunk < ATA_DMA_MAX_SECTORS ? chunk : ATA_DMA_MAX_SECTORS;
+            result = ata_dma_transfer(drive, lba, chunk, (void*)in, true);
+        }
+        if (result > 0) {
+            result = ata_pio_write(drive, lba, chunk, in);
+        }
+        if (result < 0) {
+            return -1;
+        }
+        in += chunk * BLOCK_SECTOR_SIZE;
+        lba += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+static int ata_flush(block_device_t* dev) {
+    ata_drive_t* drive = dev->driver_data;
+    if (ata_wait(drive, false) < 0) {
+        return -1;
+    }
+    outb(drive->io + ATA_REG_DRIVE, 0xE0 | (drive->slave << 4));
+    ata_delay(drive);
+    outb(drive->io + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+    ata_delay(drive);
+    return ata_wait(drive, false);
+}
+
+// Send IDENTIFY and fill in the drive if an ATA disk answers. ATAPI and
+// SATA devices identify themselves through LBA1/LBA2 and are skipped.
+static bool ata_identify(ata_drive_t* drive) {
+    uint16_t id[256];
+    
+    outb(drive->ctrl, ATA_CTRL_NIEN);
+    outb(drive->io + ATA_REG_DRIVE, 0xA0 | (drive->slave << 4));
+    ata_delay(drive);
+    outb(drive->io + ATA_REG_SECCOUNT, 0);
+    outb(drive->io + ATA_REG_LBA0, 0);
+    outb(drive->io + ATA_REG_LBA1, 0);
+    outb(drive->io + ATA_REG_LBA2, 0);
+    outb(drive->io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay(drive);
+    
+    uint8_t status = inb(drive->io + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF) {
+        return false; // Nothing attached
+    }
+    
+    uint32_t polls = 0;
+    while ((inb(drive->io + ATA_REG_STATUS) & ATA_SR_BSY) && ++polls < ATA_TIMEOUT) {}
+    if (polls == ATA_TIMEOUT) {
+        return false;
+    }
+    if (inb(drive->io + ATA_REG_LBA1) || inb(drive->io + ATA_REG_LBA2)) {
+        return false; // Not an ATA disk
+    }
+    if (ata_wait(drive, true) < 0) {
+        return false;
+    }
+    insw(drive->io + ATA_REG_DATA, id, 256);
+    
+    // Words 60-61: sectors addressable with LBA28
+    uint32_t sectors = id[60] | ((uint32_t)id[61] << 16);
+    if (sectors == 0) {
+        return false;
+    }
+    drive->dev.sector_count = sectors < ATA_LBA28_LIMIT ? sectors : ATA_LBA28_LIMIT - 1;
+    
+    // Words 27-46: model string, two bytes per word, high byte first
+    for (int i = 0; i < 20; i++) {
+        drive->model[i * 2] = id[27 + i] >> 8;
+        drive->model[i * 2 + 1] = id[27 + i] & 0xFF;
+    }
+    int end = 40;
+    while (end > 0 && drive->model[end - 1] == ' ') {
+        end--;
+    }
+    drive->model[end] = '\0';
+    return true;
+}
+
+// Find the PCI IDE function and switch on bus mastering. Only channels
+// in compatibility mode are driven, at the legacy ports and IRQs 14/15,
+// which is how PIIX controllers (QEMU's among them) come up.
+static void ata_dma_init(void) {
+    pci_device_t* ide = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE);
+    if (!ide || !(ide->prog_if & 0x80) || !(ide->bar[4] & PCI_BAR_IO) || (ide->prog_if & 0x05)) {
+        return;
+    }
+    bmide_base = ide->bar[4] & ~3;
+    pci_enable(ide, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    
+    // Unmask IRQ 14 and 15 on the slave PIC, and the cascade on the master
+    outb(0xA1, inb(0xA1) & ~0xC0);
+    outb(0x21, inb(0x21) & ~0x04);
+}
+
+// Probe both channels and register every disk found as hda, hdb, ...
+// Returns the number of disks.
+uint32_t ata_init(void) {
+    static const uint16_t ctrl_ports[] = { ATA_PRIMARY_CTRL, ATA_SECONDARY_CTRL };
+    
+    ata_dma_init();
+    for (uint32_t channel = 0; channel < 2; channel++) {
+        // A floating bus reads back 0xFF: no controller on this channel
+        if (inb(channel_io[channel] + ATA_REG_STATUS) == 0xFF) {
+            continue;
+        }
+        
+        for (uint8_t slave = 0; slave < 2; slave++) {
+            ata_drive_t* drive = &drives[drive_count];
+            drive->io = channel_io[channel];
+            drive->ctrl = ctrl_ports[channel];
+            drive->bmide = 0;
+            drive->channel = channel;
+            drive->slave = slave;
+            if (!ata_identify(drive)) {
+                continue;
+            }
+            
+            // DMA completion is signalled by interrupt, so let the drive raise it
+            if (bmide_base) {
+                drive->bmide = bmide_base + channel * ATA_BM_CHANNEL_SIZE;
+                outb(drive->ctrl, 0);
+            }
+            
+            block_device_t* dev = &drive->dev;
+            dev->name[0] = 'h';
+            dev->name[1] = 'd';
+            dev->name[2] = 'a' + channel * 2 + slave;
+            dev->name[3] = '\0';
+            dev->read = ata_read;
+            dev->write = ata_write;
+            dev->flush = ata_flush;
+            dev->driver_data = drive;
+            if (blockdev_register(dev) == 0) {
+                drive_count++;
+            }
+        }
+    }
+    return drive_count;
+}
+
+const char* ata_get_model(uint32_t drive) {
+    return drive < drive_count ? drives[drive].model : "";
+}
+
+bool ata_dma_available(void) {
+    return drive_count > 0 && drives[0].bmide != 0;
+}
+
+// Called from the IRQ 14/15 stubs. Reading the status register
+// acknowledges the drive; the transfer waiting on the channel sees the
+// bus-master interrupt bit.
+void ata_irq_handler(uint32_t channel) {
+    channel_irqs[channel]++;
+    inb(channel_io[channel] + ATA_REG_STATUS);
+}
+
+// Benchmark
+#define ATA_BENCH_SECTORS 2048   // 1MB at the start of the disk
+
+// Average cycles per unit without 64-bit division
+static uint32_t cycles_each(uint64_t cycles, uint32_t count) {
+    while (cycles >> 32) {
+        cycles >>= 1;
+        count >>= 1;
+    }
+    return count ? (uint32_t)cycles / count : 0;
+}
+
+// Print bytes per elapsed time as MB/s with one decimal, eight columns
+// wide. Bytes must stay under 400MB so the tenths fit in 32 bits.
+static void print_rate(uint32_t bytes, uint64_t cycles) {
+    uint32_t us = cycles_each(cycles, timer_tsc_per_ms() / 1000);
+    uint32_t tenths = us ? bytes * 10 / us : 0;
+    uint32_t width = 1;
+    for (uint32_t n = tenths / 10; n >= 10; n /= 10) {
+        width++;
+    }
+    for (; width < 6; width++) {
+        screen_print(" ");
+    }
+    print_number(tenths / 10);
+    screen_print(".");
+    print_number(tenths % 10);
+}
+
+static void bench_row(const char* label, uint32_t bytes, uint64_t elapsed, uint64_t waited) {
+    screen_print(label);
+    print_rate(bytes, elapsed);
+    print_column(cycles_each(elapsed, bytes / 1024), "", 11);
+    print_column(cycles_each(elapsed - waited, bytes / 1024), "", 15);
+    screen_println("");
+}
+
+// Read the first megabyte of the disk in 64KB commands by PIO and then
+// by DMA, and write each piece back with the contents it already has.
+// CPU cycles leave out the time spent waiting for DMA to complete, which
+// the idle work or other interrupts could use.
+void ata_run_benchmark(void) {
+    if (drive_count == 0) {
+        return;
+    }
+    
+    block_device_t* dev = &drives[0].dev;
+    uint32_t sectors = dev->sector_count < ATA_BENCH_SECTORS ? dev->sector_count : ATA_BENCH_SECTORS;
+    sectors &= ~(ATA_DMA_MAX_SECTORS - 1);
+    uint8_t* buffer = kmalloc_tagged(ATA_DMA_MAX_SECTORS * BLOCK_SECTOR_SIZE, MEM_TAG_DRIVERS);
+    if (sectors == 0 || !buffer) {
+        kfree(buffer);
+        screen_println("Disk too small or out of memory.");
+        return;
+    }
+    
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_print("PIO vs DMA on ");
+    screen_print(dev->name);
+    screen_print(" (");
+    print_number(sectors / 2);
+    screen_println(" KB in 64KB commands)");
+    screen_println("               MB/s  CYCLES/KB  CPU CYCLES/KB");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    uint32_t bytes = sectors * BLOCK_SECTOR_SIZE;
+    for (int dma = 0; dma <= 1; dma++) {
+        if (dma && !drives[0].bmide) {
+            screen_println("  DMA: no bus-master IDE controller");
+            break;
+        }
+        dma_enabled = dma;
+        
+        uint64_t waited = dma_wait_cycles;
+        uint64_t start = rdtsc();
+        for (uint32_t lba = 0; lba < sectors; lba += ATA_DMA_MAX_SECTORS) {
+            blockdev_read(dev, lba, ATA_DMA_MAX_SECTORS, buffer);
+        }
+        bench_row(dma ? "  DMA read " : "  PIO read ", bytes, rdtsc() - start, dma_wait_cycles - waited);
+        
+        uint64_t elapsed = 0;
+        waited = 0;
+        for (uint32_t lba = 0; lba < sectors; lba += ATA_DMA_MAX_SECTORS) {
+            if (blockdev_read(dev, lba, ATA_DMA_MAX_SECTORS, buffer) < 0) {
+                break; // Never write back data that was not read
+            }
+            uint64_t wait_before = dma_wait_cycles;
+            start = rdtsc();
+            blockdev_write(dev, lba, ATA_DMA_MAX_SECTORS, buffer);
+            elapsed += rdtsc() - start;
+            waited += dma_wait_cycles - wait_before;
+        }
+        bench_row(dma ? "  DMA write" : "  PIO write", bytes, elapsed, waited);
+    }
+    
+    dma_enabled = true;
+    blockdev_flush(dev);
+    kfree(buffer);
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
+
+// Right-align num plus suffix in a column of the given width
+static void print_column(uint32_t num, const char* suffix, uint32_t width) {
+    uint32_t length = 1;
+    for (uint32_t n = num; n >= 10; n /= 10) {
+        length++;
+    }
+    for (const char* c = suffix; *c; c++) {
+        length++;
+    }
+    for (; length < width; length++) {
+        screen_print(" ");
+    }
+    print_number(num);
+    screen_print(suffix);
+}
@@ -0,0 +1,147 @@
+#include "../include/blockdev.h"
+#include "../include/screen.h"
+
+// Registered disks, in probe order
+static block_device_t* devices[BLOCKDEV_MAX];
+static uint32_t device_count = 0;
+
+static void print_number(uint32_t num);
+
+int blockdev_register(block_device_t* dev) {
+    if (!dev || device_count == BLOCKDEV_MAX) {
+        return -1;
+    }
+    dev->index = device_count;
+    dev->read_commands = 0;
+    dev->write_commands = 0;
+    dev->sectors_read = 0;
+    dev->sectors_written = 0;
+    devices[device_count++] = dev;
+    return 0;
+}
+
+uint32_t blockdev_count(void) {
+    return device_count;
+}
+
+block_device_t* blockdev_get(uint32_t index) {
+    return index < device_count ? devices[index] : NULL;
+}
+
+int blockdev_read(block_device_t* dev, uint32_t lba, uint32_t count, void* buffer) {
+    if (!dev || count == 0 || lba >= dev->sector_count || count > dev->sector_count - lba) {
+        return -1;
+    }
+    dev->read_commands++;
+    dev->sectors_read += count;
+    return dev->read(dev, lba, count, buffer);
+}
+
+int blockdev_write(block_device_t* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    if (!dev || count == 0 || lba >= dev->sector_count || count > dev->sector_count - lba) {
+        return -1;
+    }
+    dev->write_commands++;
+    dev->sectors_written += count;
+    return dev->write(dev, lba, count, buffer);
+}
+
+// Run a batch of requests, all of them even if some fail. Returns 0 if
+// every request succeeded and -1 otherwise; each request's status says
+// which.
+int blockdev_submit(block_device_t* dev, block_request_t* requests, uint32_t count) {
+    if (!dev) {
+        return -1;
+    }
+    
+    int result = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        block_request_t* request = &requests[i];
+        request->status = 0;
+        if (request->count == 0 || request->lba >= dev->sector_count ||
+            request->count > dev->sector_count - request->lba) {
+            request->status = -1;
+            result = -1;
+            continue;
+        }
+        if (request->write) {
+            dev->write_commands++;
+            dev->sectors_written += request->count;
+        } else {
+            dev->read_commands++;
+            dev->sectors_read += request->count;
+        }
+        if (!dev->submit) {
+            request->status = request->write
+                ? dev->write(dev, request->lba, request->count, request->buffer)
+                : dev->read(dev, request->lba, request->count, request->buffer);
+            if (request->status < 0) {
+                result = -1;
+            }
+        }
+    }
+    
+    // Requests that failed the checks above are skipped by the driver
+    if (dev->submit && dev->submit(dev, requests, count) < 0) {
+        result = -1;
+    }
+    return result;
+}
+
+int blockdev_flush(block_device_t* dev) {
+    if (!dev) {
+        return -1;
+    }
+    return dev->flush ? dev->flush(dev) : 0;
+}
+
+void blockdev_print_devices(void) {
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("Block Devices:");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    if (device_count == 0) {
+        screen_println("  No disks found.");
+        return;
+    }
+    
+    for (uint32_t i = 0; i < device_count; i++) {
+        block_device_t* dev = devices[i];
+        screen_print("  ");
+        screen_print(dev->name);
+        screen_print(": ");
+        print_number(dev->sector_count / 2048);
+        screen_print("MB, ");
+        print_number(dev->read_commands);
+        screen_print(" reads (");
+        print_number(dev->sectors_read);
+        screen_print(" sectors), ");
+        print_number(dev->write_commands);
+        screen_print(" writes (");
+        print_number(dev->sectors_written);
+        screen_println(" sectors)");
+    }
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
@@ -1,6 +1,7 @@
 #include "keyboard.h"
 #include "io.h"
 #include "screen.h"
+#include "kernel.h"
 
 // US QWERTY keyboard layout (works with most keyboards regardless of physical layout)
 // Scancodes are hardware-level and layout-independent
@@ -147,8 +148,10 @@ char keyboard_getchar(void) {
             return key;
         }
         
-        // Small delay for polling - no halt instruction
-        for (volatile int i = 0; i < 10000; i++) {}
+        // Do background work while waiting; delay only if there is none
+        if (!kernel_idle()) {
+            for (volatile int i = 0; i < 10000; i++) {}
+        }
     }
 }
 
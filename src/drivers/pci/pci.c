@@ -0,0 +1,153 @@
+#include "../include/pci.h"
+#include "../include/io.h"
+#include "../include/screen.h"
+
+// Functions found at boot, in bus/slot/function order
+static pci_device_t devices[PCI_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+static void print_hex(uint32_t value, int digits);
+
+static uint32_t pci_read(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | (bus << 16) | (slot << 11) | (func << 8) | (offset & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint32_t pci_config_read32(const pci_device_t* dev, uint8_t offset) {
+    return pci_read(dev->bus, dev->slot, dev->func, offset);
+}
+
+// Narrow reads pick their bytes out of the aligned dword
+uint16_t pci_config_read16(const pci_device_t* dev, uint8_t offset) {
+    return pci_config_read32(dev, offset) >> ((offset & 2) * 8);
+}
+
+uint8_t pci_config_read8(const pci_device_t* dev, uint8_t offset) {
+    return pci_config_read32(dev, offset) >> ((offset & 3) * 8);
+}
+
+void pci_config_write32(const pci_device_t* dev, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | (dev->bus << 16) | (dev->slot << 11) | (dev->func << 8) | (offset & 0xFC));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_config_write16(const pci_device_t* dev, uint8_t offset, uint16_t value) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | (dev->bus << 16) | (dev->slot << 11) | (dev->func << 8) | (offset & 0xFC));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+// Set bits in the command register, e.g. to let a device master the bus
+void pci_enable(const pci_device_t* dev, uint16_t bits) {
+    pci_config_write16(dev, PCI_COMMAND, pci_config_read16(dev, PCI_COMMAND) | bits);
+}
+
+static void pci_add(uint8_t bus, uint8_t slot, uint8_t func) {
+    if (device_count == PCI_MAX_DEVICES) {
+        return;
+    }
+    
+    pci_device_t* dev = &devices[device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    uint32_t id = pci_config_read32(dev, PCI_VENDOR_ID);
+    dev->vendor_id = id & 0xFFFF;
+    dev->device_id = id >> 16;
+    uint32_t class_reg = pci_config_read32(dev, 0x08);
+    dev->prog_if = class_reg >> 8;
+    dev->subclass = class_reg >> 16;
+    dev->class_code = class_reg >> 24;
+    dev->irq_line = pci_config_read8(dev, PCI_INTERRUPT_LINE);
+    for (int i = 0; i < 6; i++) {
+        dev->bar[i] = pci_config_read32(dev, PCI_BAR0 + i * 4);
+    }
+}
+
+// Scan every bus and slot. Function 0 answering with the multi-function
+// bit set means functions 1-7 are worth probing too.
+void pci_init(void) {
+    device_count = 0;
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            if ((pci_read(bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) {
+                continue;
+            }
+            pci_add(bus, slot, 0);
+            
+            uint8_t header = pci_read(bus, slot, 0, PCI_HEADER_TYPE & 0xFC) >> 16;
+            if (!(header & PCI_HEADER_MULTIFUNC)) {
+                continue;
+            }
+            for (uint8_t func = 1; func < 8; func++) {
+                if ((pci_read(bus, slot, func, PCI_VENDOR_ID) & 0xFFFF) != 0xFFFF) {
+                    pci_add(bus, slot, func);
+                }
+            }
+        }
+    }
+}
+
+uint32_t pci_device_count(void) {
+    return device_count;
+}
+
+pci_device_t* pci_get_device(uint32_t index) {
+    return index < device_count ? &devices[index] : NULL;
+}
+
+pci_device_t* pci_find_class(uint8_t class_code, uint8_t subclass) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (devices[i].class_code == class_code && devices[i].subclass == subclass) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (devices[i].vendor_id == vendor_id && devices[i].device_id == device_id) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+void pci_print_devices(void) {
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("PCI Devices:");
+    screen_println("  LOC      VENDOR DEVICE CLASS IRQ");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    for (uint32_t i = 0; i < device_count; i++) {
+        pci_device_t* dev = &devices[i];
+        screen_print("  ");
+        print_hex(dev->bus, 2);
+        screen_print(":");
+        print_hex(dev->slot, 2);
+        screen_print(".");
+        print_hex(dev->func, 1);
+        screen_print("  ");
+        print_hex(dev->vendor_id, 4);
+        screen_print("   ");
+        print_hex(dev->device_id, 4);
+        screen_print("   ");
+        print_hex(dev->class_code, 2);
+        print_hex(dev->subclass, 2);
+        screen_print("  ");
+        print_hex(dev->irq_line, 2);
+        screen_println("");
+    }
+}
+
+// Fixed-width hex, as lspci shows it
+static void print_hex(uint32_t value, int digits) {
+    const char* hex = "0123456789abcdef";
+    char str[9];
+    for (int i = digits - 1; i >= 0; i--) {
+        str[i] = hex[value & 0xF];
+        value >>= 4;
+    }
+    str[digits] = '\0';
+    screen_print(str);
+}
@@ -5,7 +5,17 @@
 #include "timer.h"
 #include "memory.h"
 #include "filesystem.h"
+#include "paging.h"
+#include "slab.h"
+#include "zram.h"
+#include "string.h"
+#include "arena.h"
 #include "io.h"
+#include "blockdev.h"
+#include "bcache.h"
+#include "ata.h"
+#include "virtio_blk.h"
+#include "pci.h"
 
 // String comparison function
 static int strcmp(const char* str1, const char* str2) {
@@ -23,30 +33,55 @@ static int strlen(const char* str) {
     return len;
 }
 
-// Command parsing - split command into parts
-static int parse_command(const char* input, char* cmd, char* arg) {
-    int i = 0, j = 0;
-    
-    // Skip leading spaces
-    while (input[i] == ' ') i++;
+// Scratch memory for the command being executed; reset after every command
+static arena_t shell_arena;
+
+// Parsed command line. All strings live in the shell arena.
+typedef struct {
+    int argc;
+    char** argv;          // argv[0] is the command, NULL-terminated
+    const char* argument; // Everything after the command, as typed
+} shell_args_t;
+
+// Command parsing - split the line into words
+static int parse_command(const char* input, shell_args_t* args) {
+    int i = 0;
+    int words = 0;
     
-    // Copy command
-    while (input[i] && input[i] != ' ') {
-        cmd[j++] = input[i++];
+    // Count words first so argv can be sized exactly
+    for (int k = 0; input[k]; k++) {
+        if (input[k] != ' ' && (k == 0 || input[k - 1] == ' ')) {
+            words++;
+        }
     }
-    cmd[j] = '\0';
     
-    // Skip spaces between command and argument
-    while (input[i] == ' ') i++;
+    args->argc = 0;
+    args->argv = arena_alloc(&shell_arena, (words + 1) * sizeof(char*));
+    args->argument = "";
+    if (!args->argv) {
+        return -1;
+    }
     
-    // Copy argument
-    j = 0;
     while (input[i]) {
-        arg[j++] = input[i++];
+        // Skip spaces between words
+        while (input[i] == ' ') i++;
+        if (!input[i]) break;
+        
+        if (args->argc == 1) {
+            args->argument = arena_strndup(&shell_arena, &input[i], strlen(&input[i]));
+        }
+        
+        int start = i;
+        while (input[i] && input[i] != ' ') i++;
+        args->argv[args->argc] = arena_strndup(&shell_arena, &input[start], i - start);
+        if (!args->argv[args->argc] || !args->argument) {
+            return -1;
+        }
+        args->argc++;
     }
-    arg[j] = '\0';
+    args->argv[args->argc] = NULL;
     
-    return (strlen(arg) > 0) ? 2 : 1; // Return number of parts
+    return args->argc;
 }
 
 // Simple number printing function
@@ -90,8 +125,8 @@ static void print_hex(uint32_t num) {
 // Available commands for tab completion
 static const char* shell_commands[] = {
     "help", "clear", "echo", "about", "version", "time", "sleep", 
-    "calc", "colors", "memory", "memtest", "ls", "cat", "create", 
-    "delete", "edit", "copy", "fsinfo", "ps", "uptime", "sysinfo", "reboot"
+    "calc", "colors", "memory", "heapstat", "memtest", "shrinktest", "pagebench", "slabinfo", "memspeed", "zram", "zramtest", "ls", "mkdir", "cat", "create", 
+    "delete", "edit", "copy", "fsinfo", "fsbench", "sync", "disks", "bcache", "diskbench", "virtio", "lspci", "ps", "uptime", "sysinfo", "reboot"
 };
 #define NUM_COMMANDS (sizeof(shell_commands) / sizeof(shell_commands[0]))
 
@@ -104,6 +139,21 @@ static int strncmp(const char* str1, const char* str2, int n) {
     return 0;
 }
 
+// Parse a decimal number, returning fallback if the string isn't one
+static uint32_t parse_number(const char* str, uint32_t fallback) {
+    uint32_t value = 0;
+    if (!*str) {
+        return fallback;
+    }
+    for (; *str; str++) {
+        if (*str < '0' || *str > '9') {
+            return fallback;
+        }
+        value = value * 10 + (*str - '0');
+    }
+    return value;
+}
+
 // Tab completion function
 static int tab_complete(char* buffer, int buffer_len) {
     if (buffer_len == 0) return buffer_len;
@@ -151,6 +201,8 @@ static int tab_complete(char* buffer, int buffer_len) {
 }
 
 void shell_init(void) {
+    arena_init(&shell_arena, SHELL_ARENA_CHUNK);
+    
     screen_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
     screen_println("");
     screen_println("TRAKOS Shell v1.0");
@@ -164,10 +216,10 @@ void shell_print_prompt(void) {
     screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
 }
 
-void shell_execute_command(const char* input) {
-    char command[64];
-    char argument[64];
-    int parts = parse_command(input, command, argument);
+static void run_command(const shell_args_t* args) {
+    const char* command = args->argc ? args->argv[0] : "";
+    const char* argument = args->argument;
+    int parts = args->argc > 1 ? 2 : 1;
     
     if (strcmp(command, "help") == 0) {
         screen_set_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK);
@@ -182,20 +234,35 @@ void shell_execute_command(const char* input) {
         screen_println("  sleep     - Sleep for 2 seconds (demo)");
         screen_println("  calc      - Simple calculator (add 5+3)");
         screen_println("  colors    - Show color test");
-        screen_println("  memory    - Show memory statistics");
+        screen_println("  memory    - Show memory statistics and per-subsystem usage");
+        screen_println("  heapstat  - Show heap size classes and fragmentation");
         screen_println("  memtest   - Test memory allocation");
-        screen_println("  ls        - List files in file system");
+        screen_println("  shrinktest - Fill memory and check reclaim via shrinkers");
+        screen_println("  pagebench - Compare 4KB and 4MB page TLB cost");
+        screen_println("  slabinfo  - Show slab object caches");
+        screen_println("  memspeed [copy|set|cmp] - Benchmark memory routines");
+        screen_println("  zram      - Show compressed memory statistics");
+        screen_println("  zramtest [MB] - Overflow pageable memory into the compressed store");
+        screen_println("  ls [dir]  - List files in a directory (default: root)");
+        screen_println("  mkdir <path> - Create a directory");
         screen_println("  cat <file> - Display file contents");
         screen_println("  create <file> - Create new file");
         screen_println("  delete <file> - Delete file");
         screen_println("  edit <file> - Edit file contents");
         screen_println("  copy <src> <dst> - Copy file");
         screen_println("  fsinfo    - Show file system information");
-        screen_println("  ps        - Show system processes");
+        screen_println("  fsbench   - Benchmark file store use and throughput");
+        screen_println("  sync      - Write file changes to disk now");
+        screen_println("  disks     - List block devices and their traffic");
+        screen_println("  bcache    - Show buffer cache statistics");
+        screen_println("  diskbench - Benchmark the buffer cache, PIO against DMA, virtio queue depth");
+        screen_println("  virtio    - Show virtio-blk queue and batching statistics");
+        screen_println("  lspci     - List PCI devices");
+        screen_println("  ps        - Show subsystems and their live heap memory");
         screen_println("  uptime    - Show detailed system uptime");
         screen_println("  sysinfo   - Show complete system info");
         screen_println("  reboot    - Restart the system");
-        screen_println("  memory    - Show memory statistics");
+        screen_println("  memory    - Show memory statistics and per-subsystem usage");
         screen_println("  memtest   - Test memory allocation");
         screen_println("  reboot    - Restart the system");
         
@@ -254,6 +321,9 @@ void shell_execute_command(const char* input) {
     } else if (strcmp(command, "memory") == 0) {
         memory_print_stats();
         
+    } else if (strcmp(command, "heapstat") == 0) {
+        memory_print_heap_stats();
+        
     } else if (strcmp(command, "memtest") == 0) {
         screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
         screen_println("Memory Allocation Test:");
@@ -270,14 +340,51 @@ void shell_execute_command(const char* input) {
         print_hex((uint32_t)ptr2);
         screen_println("");
         
+        void* ptr3 = kmalloc_aligned(100, HEAP_CACHE_LINE);
+        screen_print("Allocated 100 bytes, cache-line aligned, at: 0x");
+        print_hex((uint32_t)ptr3);
+        screen_println("");
+        
+        void* ptr4 = kmalloc(3 * PAGE_SIZE);
+        screen_print("Allocated 12KB from whole pages at: 0x");
+        print_hex((uint32_t)ptr4);
+        screen_println("");
+        
         screen_println("Freeing first allocation...");
         kfree(ptr1);
         
         screen_println("Freeing second allocation...");
         kfree(ptr2);
         
+        screen_println("Freeing aligned and page allocations...");
+        kfree(ptr3);
+        kfree(ptr4);
+        
         screen_println("Memory test complete!");
         
+    } else if (strcmp(command, "shrinktest") == 0) {
+        memory_run_shrink_test();
+        
+    } else if (strcmp(command, "pagebench") == 0) {
+        paging_run_benchmark();
+        
+    } else if (strcmp(command, "slabinfo") == 0) {
+        kmem_cache_print_stats();
+        
+    } else if (strcmp(command, "memspeed") == 0) {
+        string_run_benchmark(parts > 1 ? argument : "copy");
+        
+    } else if (strcmp(command, "zram") == 0) {
+        zram_print_stats();
+        
+    } else if (strcmp(command, "zramtest") == 0) {
+        uint32_t megabytes = parse_number(argument, 16);
+        if (megabytes == 0 || megabytes > ZRAM_WINDOW_SIZE / (1024 * 1024)) {
+            screen_println("Usage: zramtest [1-256 MB]");
+        } else {
+            zram_run_test(megabytes);
+        }
+        
     } else if (strcmp(command, "time") == 0) {
         uint32_t ticks = timer_get_ticks();
         uint32_t seconds = ticks / 100; // 100Hz timer
@@ -314,11 +421,71 @@ void shell_execute_command(const char* input) {
         screen_println("Echo: Type something after 'echo' command");
         
     } else if (strcmp(command, "ls") == 0) {
-        fs_list_files();
+        fs_list_files(parts > 1 ? argument : NULL);
+        
+    } else if (strcmp(command, "mkdir") == 0) {
+        if (parts < 2) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_println("Usage: mkdir <path>");
+            return;
+        }
+        
+        int result = fs_create_file(argument, FILE_TYPE_DIRECTORY);
+        if (result >= 0) {
+            screen_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+            screen_print("Created directory '");
+            screen_print(argument);
+            screen_println("'");
+        } else {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            if (result == -2) {
+                screen_println("A file or directory with that name already exists!");
+            } else if (result == -4) {
+                screen_println("Parent directory not found!");
+            } else {
+                screen_println("Failed to create directory!");
+            }
+        }
         
     } else if (strcmp(command, "fsinfo") == 0) {
         fs_print_info();
         
+    } else if (strcmp(command, "fsbench") == 0) {
+        fs_run_benchmark();
+        
+    } else if (strcmp(command, "sync") == 0) {
+        int result = fs_sync();
+        if (result == 0) {
+            screen_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+            screen_println("File system written to disk.");
+        } else {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            if (result == -1) {
+                screen_println("No disk; files live in memory only.");
+            } else if (result == -3) {
+                screen_println("Disk too small for the file system!");
+            } else {
+                screen_println("Disk error during sync!");
+            }
+        }
+        
+    } else if (strcmp(command, "disks") == 0) {
+        blockdev_print_devices();
+        
+    } else if (strcmp(command, "bcache") == 0) {
+        bcache_print_stats();
+        
+    } else if (strcmp(command, "diskbench") == 0) {
+        bcache_run_benchmark(blockdev_get(0));
+        ata_run_benchmark();
+        virtio_blk_run_benchmark();
+        
+    } else if (strcmp(command, "virtio") == 0) {
+        virtio_blk_print_stats();
+        
+    } else if (strcmp(command, "lspci") == 0) {
+        pci_print_devices();
+        
     } else if (strcmp(command, "cat") == 0) {
         if (parts < 2) {
             screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
@@ -334,11 +501,20 @@ void shell_execute_command(const char* input) {
             screen_println(":");
             screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
             
-            char buffer[512];
-            int bytes_read = fs_read_file(file, buffer, sizeof(buffer) - 1);
-            if (bytes_read > 0) {
-                buffer[bytes_read] = '\0';
-                screen_println(buffer);
+            // Print straight from the file's blocks, however long it is
+            fs_view_t views[FS_VIEW_BATCH];
+            uint32_t printed = 0;
+            int count;
+            while ((count = fs_read_view(file, 0xFFFFFFFF, views, FS_VIEW_BATCH)) > 0) {
+                for (int v = 0; v < count; v++) {
+                    for (uint32_t j = 0; j < views[v].length; j++) {
+                        screen_putchar(views[v].data[j]);
+                    }
+                    printed += views[v].length;
+                }
+            }
+            if (printed > 0) {
+                screen_println("");
             } else {
                 screen_println("File is empty or error reading file.");
             }
@@ -378,6 +554,8 @@ void shell_execute_command(const char* input) {
                 screen_print("File '");
                 screen_print(argument);
                 screen_println("' already exists!");
+            } else if (result == -4) {
+                screen_println("Parent directory not found!");
             } else {
                 screen_println("Failed to create file!");
             }
@@ -396,6 +574,16 @@ void shell_execute_command(const char* input) {
             screen_print("Deleted file '");
             screen_print(argument);
             screen_println("' successfully!");
+        } else if (result == -3) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_print("Directory '");
+            screen_print(argument);
+            screen_println("' is not empty!");
+        } else if (result == -5) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_print("File '");
+            screen_print(argument);
+            screen_println("' is part of the read-only initrd!");
         } else {
             screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
             screen_print("File '");
@@ -403,6 +591,87 @@ void shell_execute_command(const char* input) {
             screen_println("' not found or error deleting!");
         }
         
+    } else if (strcmp(command, "copy") == 0) {
+        if (args->argc < 3) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_println("Usage: copy <src> <dst>");
+            return;
+        }
+        
+        const char* src_path = args->argv[1];
+        const char* dst_path = args->argv[2];
+        
+        // Files in the store are cloned and share blocks until one of the
+        // two is written; initrd files are copied through views
+        int result = fs_clone_file(src_path, dst_path);
+        uint32_t copied = fs_get_file_size(src_path);
+        bool complete = true;
+        if (result == -6) {
+            file_handle_t* src = fs_open_file(src_path);
+            result = fs_create_file(dst_path, FILE_TYPE_REGULAR);
+            file_handle_t* dst = result >= 0 ? fs_open_file(dst_path) : NULL;
+            complete = src && dst;
+            
+            // Views let the data go from the source straight to the
+            // destination blocks in one copy, with no buffer in between
+            fs_view_t views[FS_VIEW_BATCH];
+            int count = 0;
+            copied = 0;
+            while (complete && (count = fs_read_view(src, 0xFFFFFFFF, views, FS_VIEW_BATCH)) > 0) {
+                for (int v = 0; v < count; v++) {
+                    int written = fs_write_file(dst, views[v].data, views[v].length);
+                    if (written != (int)views[v].length) {
+                        complete = false;
+                        break;
+                    }
+                    copied += written;
+                }
+            }
+            if (count < 0) {
+                complete = false;
+            }
+            fs_close_file(src);
+            fs_close_file(dst);
+            
+            // Leave no truncated copy behind
+            if (result >= 0 && !complete) {
+                fs_delete_file(dst_path);
+            }
+        }
+        
+        if (result >= 0 && complete) {
+            screen_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+            screen_print("Copied ");
+            print_number(copied);
+            screen_print(" bytes to '");
+            screen_print(dst_path);
+            screen_println("'");
+        } else if (result == -5) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_print("File '");
+            screen_print(src_path);
+            screen_println("' not found!");
+        } else if (result == -2) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_print("File '");
+            screen_print(dst_path);
+            screen_println("' already exists!");
+        } else if (result == -7) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_print("'");
+            screen_print(src_path);
+            screen_println("' is a directory!");
+        } else if (result == -4) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_println("Parent directory not found!");
+        } else if (result >= 0) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_println("Copy failed; the partial copy was removed!");
+        } else {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_println("Failed to create file!");
+        }
+        
     } else if (strcmp(command, "edit") == 0) {
         if (parts < 2) {
             screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
@@ -418,10 +687,15 @@ void shell_execute_command(const char* input) {
         screen_println("---");
         
         // Simple text input for file editing
-        char file_content[512] = {0};
+        char* file_content = arena_alloc(&shell_arena, SHELL_EDIT_LIMIT);
         uint32_t content_pos = 0;
+        if (!file_content) {
+            screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            screen_println("Out of memory!");
+            return;
+        }
         
-        while (content_pos < sizeof(file_content) - 1) {
+        while (content_pos < SHELL_EDIT_LIMIT) {
             char key = keyboard_getchar();
             if (key == 27) { // ESC key
                 break;
@@ -465,11 +739,36 @@ void shell_execute_command(const char* input) {
         screen_println("System Processes:");
         screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
         screen_println("  PID  NAME        STATUS   MEMORY");
-        screen_println("   1   kernel      running   4MB");
-        screen_println("   2   shell       running   1MB");
-        screen_println("   3   filesystem  running   2MB");
-        screen_println("   4   timer       running   <1MB");
-        screen_println("Total: 4 processes");
+        
+        // One row per allocation tag, with what it has live right now
+        uint32_t processes = 0;
+        for (uint32_t tag = 0; tag < MEM_TAG_COUNT; tag++) {
+            mem_tag_stats_t usage;
+            memory_get_tag_stats((mem_tag_t)tag, &usage);
+            processes++;
+            
+            screen_print("   ");
+            print_number(processes);
+            screen_print("   ");
+            screen_print(usage.name);
+            for (int length = strlen(usage.name); length < 12; length++) {
+                screen_print(" ");
+            }
+            screen_print("running  ");
+            if (usage.live_bytes >= 1024 * 1024) {
+                print_number(usage.live_bytes / (1024 * 1024));
+                screen_println("MB");
+            } else if (usage.live_bytes >= 1024) {
+                print_number(usage.live_bytes / 1024);
+                screen_println("KB");
+            } else {
+                print_number(usage.live_bytes);
+                screen_println("B");
+            }
+        }
+        screen_print("Total: ");
+        print_number(processes);
+        screen_println(" processes");
         
     } else if (strcmp(command, "uptime") == 0) {
         uint32_t ticks = timer_get_ticks();
@@ -517,7 +816,7 @@ void shell_execute_command(const char* input) {
         
         screen_println("Hardware:");
         screen_println("  CPU: x86 Compatible");
-        screen_println("  Memory: 4MB heap + system");
+        screen_println("  Memory: Multiboot map, on-demand heap");
         screen_println("  Display: VGA Text Mode 80x25");
         screen_println("  Timer: PIT 100Hz");
         screen_println("");
@@ -525,7 +824,13 @@ void shell_execute_command(const char* input) {
         screen_println("Features:");
         screen_println("  - Interrupt-driven I/O");
         screen_println("  - Memory management");
-        screen_println("  - File system (in-memory)");
+        if (fs_is_persistent()) {
+            screen_print("  - File system (saved to disk ");
+            screen_print(fs_disk_name());
+            screen_println(")");
+        } else {
+            screen_println("  - File system (in memory, no disk)");
+        }
         screen_println("  - Shell with 20+ commands");
         screen_println("  - Text editor");
         screen_println("  - Process simulation");
@@ -533,6 +838,10 @@ void shell_execute_command(const char* input) {
     } else if (strcmp(command, "reboot") == 0) {
         screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
         screen_println("Rebooting system...");
+        // Changes still waiting for the idle sync would be lost
+        if (fs_is_persistent() && fs_sync() < 0) {
+            screen_println("Could not write files to disk!");
+        }
         // Reboot using keyboard controller
         outb(0x64, 0xFE);
         
@@ -548,6 +857,25 @@ void shell_execute_command(const char* input) {
     }
 }
 
+void shell_execute_command(const char* input) {
+    shell_args_t args;
+    
+    // Whatever the command allocates is the shell's, unless a subsystem
+    // it calls into charges its own tag
+    mem_tag_t previous_tag = memory_set_tag(MEM_TAG_SHELL);
+    
+    if (parse_command(input, &args) < 0) {
+        screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+        screen_println("Out of memory!");
+    } else {
+        run_command(&args);
+    }
+    
+    // Everything the command allocated from the arena goes at once
+    arena_reset(&shell_arena);
+    memory_set_tag(previous_tag);
+}
+
 void shell_run(void) {
     shell_print_prompt();
     
@@ -1,10 +1,34 @@
 #include "../include/timer.h"
 #include "../include/io.h"
 #include "../include/screen.h"
+#include "../include/cpu.h"
 
 // Global tick counter
 static volatile uint32_t timer_ticks = 0;
 
+// TSC cycles per millisecond, measured against the PIT at init
+static uint32_t tsc_per_ms = 0;
+
+// Time PIT channel 2 counting down TIMER_CALIBRATE_MS worth of input
+// clocks. It is polled through port 0x61, so this works before
+// interrupts are enabled, and in safe mode where they never are.
+static void timer_calibrate_tsc(void) {
+    uint32_t count = PIT_FREQUENCY / 1000 * TIMER_CALIBRATE_MS;
+    
+    // Gate channel 2 on with the speaker off, then load a one-shot count
+    outb(TIMER_GATE_PORT, (inb(TIMER_GATE_PORT) & ~0x02) | 0x01);
+    outb(TIMER_COMMAND, TIMER_MODE_CH2_ONESHOT);
+    outb(TIMER_DATA + 2, count & 0xFF);
+    outb(TIMER_DATA + 2, (count >> 8) & 0xFF);
+    
+    uint64_t start = rdtsc();
+    while (!(inb(TIMER_GATE_PORT) & 0x20)) {}
+    uint64_t cycles = rdtsc() - start;
+    
+    // Under 2^32 cycles for any CPU slower than 400GHz
+    tsc_per_ms = (uint32_t)cycles / TIMER_CALIBRATE_MS;
+}
+
 void timer_init(uint32_t frequency) {
     // Calculate the divisor for the desired frequency
     uint32_t divisor = PIT_FREQUENCY / frequency;
@@ -18,6 +42,7 @@ void timer_init(uint32_t frequency) {
     
     // Reset tick counter
     timer_ticks = 0;
+    timer_calibrate_tsc();
     
     // Enable timer interrupt (IRQ0)
     uint8_t mask = inb(0x21);
@@ -40,6 +65,10 @@ uint32_t timer_get_ticks(void) {
     return timer_ticks;
 }
 
+uint32_t timer_tsc_per_ms(void) {
+    return tsc_per_ms;
+}
+
 void timer_wait(uint32_t ticks) {
     uint32_t start_ticks = timer_ticks;
     while ((timer_ticks - start_ticks) < ticks) {
@@ -0,0 +1,160 @@
+#include "../include/virtio.h"
+#include "../include/io.h"
+#include "../include/pmm.h"
+#include "../include/string.h"
+
+// Keep the compiler from moving ring writes across the index update; x86
+// does not reorder stores with other stores
+#define virtq_barrier() asm volatile ("" ::: "memory")
+
+// Full fence: x86 lets a load pass an earlier store, so reading the
+// device's notify flag after publishing needs this. A locked add works on
+// every CPU, with or without SSE2's mfence.
+#define virtq_full_barrier() asm volatile ("lock; addl $0, (%%esp)" ::: "memory", "cc")
+
+// Reset the device, announce a driver and agree on features: the ones
+// wanted that the device also offers
+bool virtio_init_device(virtio_device_t* vdev, pci_device_t* pci, uint32_t wanted_features) {
+    if (!(pci->bar[0] & PCI_BAR_IO)) {
+        return false;
+    }
+    vdev->pci = pci;
+    vdev->io = pci->bar[0] & ~3;
+    vdev->irq = pci->irq_line;
+    pci_enable(pci, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    
+    outb(vdev->io + VIRTIO_REG_DEVICE_STATUS, 0);
+    outb(vdev->io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(vdev->io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    
+    vdev->features = inl(vdev->io + VIRTIO_REG_DEVICE_FEATURES) & wanted_features;
+    outl(vdev->io + VIRTIO_REG_GUEST_FEATURES, vdev->features);
+    return true;
+}
+
+void virtio_driver_ok(virtio_device_t* vdev) {
+    outb(vdev->io + VIRTIO_REG_DEVICE_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+}
+
+// Reading the ISR status acknowledges the interrupt
+uint8_t virtio_read_isr(virtio_device_t* vdev) {
+    return inb(vdev->io + VIRTIO_REG_ISR_STATUS);
+}
+
+uint8_t virtio_config_read8(virtio_device_t* vdev, uint32_t offset) {
+    return inb(vdev->io + VIRTIO_REG_CONFIG + offset);
+}
+
+uint32_t virtio_config_read32(virtio_device_t* vdev, uint32_t offset) {
+    return inl(vdev->io + VIRTIO_REG_CONFIG + offset);
+}
+
+// Allocate queue index in physically contiguous frames and give it to the
+// device. Every descriptor starts out on the free chain.
+bool virtq_init(virtio_device_t* vdev, virtqueue_t* vq, uint16_t index) {
+    outw(vdev->io + VIRTIO_REG_QUEUE_SELECT, index);
+    uint16_t size = inw(vdev->io + VIRTIO_REG_QUEUE_SIZE);
+    if (size == 0) {
+        return false; // No such queue
+    }
+    
+    uint32_t ring_bytes = size * sizeof(virtq_desc_t) + sizeof(virtq_avail_t) + (size + 1) * sizeof(uint16_t);
+    uint32_t used_offset = (ring_bytes + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+    uint32_t used_bytes = sizeof(virtq_used_t) + size * sizeof(virtq_used_elem_t) + sizeof(uint16_t);
+    uint32_t frames = (used_offset + used_bytes + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t base = pmm_alloc_frames(frames);
+    if (!base) {
+        return false;
+    }
+    
+    // All RAM is identity mapped, so the frames are usable where they are
+    memset((void*)base, 0, frames * FRAME_SIZE);
+    vq->index = index;
+    vq->size = size;
+    vq->desc = (virtq_desc_t*)base;
+    vq->avail = (virtq_avail_t*)(base + size * sizeof(virtq_desc_t));
+    vq->used = (volatile virtq_used_t*)(base + used_offset);
+    vq->last_used = 0;
+    vq->kicked = 0;
+    
+    for (uint16_t i = 0; i < size; i++) {
+        vq->desc[i].next = i + 1 < size ? i + 1 : VIRTQ_NO_DESC;
+    }
+    vq->free_head = 0;
+    vq->free_count = size;
+    
+    outl(vdev->io + VIRTIO_REG_QUEUE_PFN, base / VIRTQ_ALIGN);
+    return true;
+}
+
+// Take count descriptors off the free chain, linked in order. Returns the
+// head, or VIRTQ_NO_DESC if too few are free. The caller fills in the
+// addresses, lengths and flags; NEXT is already set on all but the last.
+uint16_t virtq_alloc_chain(virtqueue_t* vq, uint16_t count) {
+    if (count == 0 || count > vq->free_count) {
+        return VIRTQ_NO_DESC;
+    }
+    
+    uint16_t head = vq->free_head;
+    uint16_t last = head;
+    for (uint16_t i = 1; i < count; i++) {
+        vq->desc[last].flags = VIRTQ_DESC_F_NEXT;
+        last = vq->desc[last].next;
+    }
+    vq->desc[last].flags = 0;
+    vq->free_head = vq->desc[last].next;
+    vq->free_count -= count;
+    return head;
+}
+
+void virtq_free_chain(virtqueue_t* vq, uint16_t head) {
+    uint16_t last = head;
+    uint16_t count = 1;
+    while (vq->desc[last].flags & VIRTQ_DESC_F_NEXT) {
+        last = vq->desc[last].next;
+        count++;
+    }
+    vq->desc[last].next = vq->free_head;
+    vq->free_head = head;
+    vq->free_count += count;
+}
+
+// Make a chain visible to the device. It is not told until virtq_kick, so
+// a batch of chains costs a single notification.
+void virtq_publish(virtqueue_t* vq, uint16_t head) {
+    vq->avail->ring[vq->avail->idx % vq->size] = head;
+    virtq_barrier();
+    vq->avail->idx++;
+}
+
+// Notify the device of everything published since the last kick, unless
+// it has asked not to be. Returns true if a notification was sent.
+bool virtq_kick(virtio_device_t* vdev, virtqueue_t* vq) {
+    virtq_barrier();
+    if (vq->avail->idx == vq->kicked) {
+        return false;
+    }
+    vq->kicked = vq->avail->idx;
+    // The device must see the new index before we read its flag, or it
+    // may stop polling after we decide a notification is not needed
+    virtq_full_barrier();
+    if (vq->used->flags & VIRTQ_USED_F_NO_NOTIFY) {
+        return false;
+    }
+    outw(vdev->io + VIRTIO_REG_QUEUE_NOTIFY, vq->index);
+    return true;
+}
+
+// Next finished chain from the used ring, if any
+bool virtq_next_used(virtqueue_t* vq, uint16_t* head, uint32_t* len) {
+    if (vq->last_used == vq->used->idx) {
+        return false;
+    }
+    virtq_barrier();
+    volatile virtq_used_elem_t* elem = &vq->used->ring[vq->last_used % vq->size];
+    *head = elem->id;
+    *len = elem->len;
+    vq->last_used++;
+    return true;
+}
@@ -0,0 +1,515 @@
+#include "../include/virtio_blk.h"
+#include "../include/idt.h"
+#include "../include/io.h"
+#include "../include/paging.h"
+#include "../include/memory.h"
+#include "../include/timer.h"
+#include "../include/cpu.h"
+#include "../include/screen.h"
+
+// Per-chain bookkeeping, indexed by the chain's head descriptor. The
+// header and status byte are what the device reads and writes.
+typedef struct {
+    virtio_blk_header_t header;
+    uint8_t status;
+    block_request_t* request;                // NULL for a flush
+} virtio_blk_slot_t;
+
+// A request piece as physically contiguous segments
+typedef struct {
+    uint32_t address;
+    uint32_t bytes;
+} virtio_blk_segment_t;
+
+extern void virtio_irq_handler(void);
+
+static virtio_device_t vdev;
+static virtqueue_t queue;
+static virtio_blk_slot_t* slots = NULL;
+static block_device_t disk;
+static bool present = false;
+static bool irq_installed = false;
+static volatile uint32_t in_flight = 0;
+static virtio_blk_stats_t stats;
+
+static void print_number(uint32_t num);
+static void print_column(uint32_t num, const char* suffix, uint32_t width);
+
+// Take every finished chain off the used ring: record its status, free
+// its descriptors. Runs from the IRQ handler, or from the waiter with
+// interrupts off, never both at once.
+static void virtio_blk_reap(void) {
+    uint16_t head;
+    uint32_t length;
+    uint32_t reaped = 0;
+    while (virtq_next_used(&queue, &head, &length)) {
+        virtio_blk_slot_t* slot = &slots[head];
+        if (slot->status != VIRTIO_BLK_S_OK) {
+            stats.errors++;
+            if (slot->request) {
+                slot->request->status = -1;
+            }
+        }
+        virtq_free_chain(&queue, head);
+        in_flight--;
+        reaped++;
+    }
+    if (reaped) {
+        stats.completions += reaped;
+        stats.reaps++;
+        if (reaped > stats.max_reaped) {
+            stats.max_reaped = reaped;
+        }
+    }
+}
+
+// Reap with interrupts off, so the IRQ handler cannot run in between
+static void virtio_blk_reap_locked(void) {
+    uint32_t flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    virtio_blk_reap();
+    if (flags & 0x200) {
+        asm volatile ("sti" ::: "memory");
+    }
+}
+
+// Like the ATA driver: do the allocator's idle work while the device is
+// busy, otherwise halt until its interrupt if one can arrive
+static void virtio_blk_pause(void) {
+    if (memory_idle() || !irq_installed) {
+        return;
+    }
+    uint32_t flags;
+    asm volatile ("pushf; pop %0" : "=r"(flags));
+    if (flags & 0x200) {
+        asm volatile ("cli");
+        if (queue.last_used == queue.used->idx) {
+            asm volatile ("sti; hlt");
+        } else {
+            asm volatile ("sti");
+        }
+    }
+}
+
+// Wait until no more than target chains are outstanding. Returns false
+// if the device stops making progress.
+static bool virtio_blk_wait(uint32_t target) {
+    uint64_t start = rdtsc();
+    uint64_t timeout = (uint64_t)VIRTIO_BLK_TIMEOUT_MS * timer_tsc_per_ms();
+    uint32_t last = in_flight;
+    
+    virtio_blk_reap_locked();
+    while (in_flight > target) {
+        if (in_flight != last) {
+            last = in_flight;
+            start = rdtsc();
+        } else if (rdtsc() - start > timeout) {
+            return false;
+        }
+        virtio_blk_pause();
+        virtio_blk_reap_locked();
+    }
+    return true;
+}
+
+// Describe up to VIRTIO_BLK_MAX_SECTORS of a buffer page by page,
+// merging pages that are physically adjacent. Returns the segment count,
+// or 0 if part of the buffer is unmapped.
+static uint32_t virtio_blk_segments(virtio_blk_segment_t* segments, uint32_t virt, uint32_t bytes) {
+    uint32_t n = 0;
+    while (bytes > 0) {
+        uint32_t phys = paging_get_physical(virt);
+        if (!phys) {
+            return 0;
+        }
+        uint32_t chunk = FRAME_SIZE - (virt & (FRAME_SIZE - 1));
+        if (chunk > bytes) {
+            chunk = bytes;
+        }
+        
+        if (n > 0 && segments[n - 1].address + segments[n - 1].bytes == phys) {
+            segments[n - 1].bytes += chunk;
+        } else {
+            segments[n].address = phys;
+            segments[n].bytes = chunk;
+            n++;
+        }
+        virt += chunk;
+        bytes -= chunk;
+    }
+    return n;
+}
+
+// Put one chain on the available ring: header, data segments, status.
+// Waits for completions to free descriptors if the ring is full. Returns
+// false if that wait times out.
+static bool virtio_blk_queue(uint32_t type, uint32_t sector, virtio_blk_segment_t* segments,
+                             uint32_t segment_count, block_request_t* request) {
+    uint16_t needed = segment_count + 2;
+    if (needed > queue.size) {
+        return false;
+    }
+    if (queue.free_count < needed) {
+        // Let the device start on what is queued so far
+        if (virtq_kick(&vdev, &queue)) {
+            stats.notifications++;
+        }
+        while (queue.free_count < needed) {
+            if (!virtio_blk_wait(in_flight - 1)) {
+                return false;
+            }
+        }
+    }
+    
+    uint16_t head = virtq_alloc_chain(&queue, needed);
+    virtio_blk_slot_t* slot = &slots[head];
+    slot->header.type = type;
+    slot->header.reserved = 0;
+    slot->header.sector = sector;
+    slot->status = 0xFF;
+    slot->request = request;
+    
+    virtq_desc_t* desc = &queue.desc[head];
+    desc->addr = paging_get_physical((uint32_t)&slot->header);
+    desc->len = sizeof(virtio_blk_header_t);
+    for (uint32_t i = 0; i < segment_count; i++) {
+        desc = &queue.desc[desc->next];
+        desc->addr = segments[i].address;
+        desc->len = segments[i].bytes;
+        desc->flags |= type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0;
+    }
+    desc = &queue.desc[desc->next];
+    desc->addr = paging_get_physical((uint32_t)&slot->status);
+    desc->len = 1;
+    desc->flags |= VIRTQ_DESC_F_WRITE;
+    
+    // The IRQ handler may reap at any time; count the chain before it can
+    // possibly complete
+    uint32_t flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    in_flight++;
+    if (in_flight > stats.max_in_flight) {
+        stats.max_in_flight = in_flight;
+    }
+    virtq_publish(&queue, head);
+    if (flags & 0x200) {
+        asm volatile ("sti" ::: "memory");
+    }
+    stats.requests++;
+    return true;
+}
+
+// Queue every request of a batch, split into pieces the device accepts,
+// then ring the doorbell once and wait for all of them together
+static int virtio_blk_submit(block_device_t* dev, block_request_t* requests, uint32_t count) {
+    (void)dev;
+    virtio_blk_segment_t segments[VIRTIO_BLK_MAX_SEGMENTS];
+    uint32_t queued = stats.requests;
+    bool stalled = false;
+    
+    for (uint32_t i = 0; i < count && !stalled; i++) {
+        block_request_t* request = &requests[i];
+        if (request->status < 0) {
+            continue; // Failed blockdev_submit's range check
+        }
+        
+        uint32_t type = request->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+        uint32_t lba = request->lba;
+        uint32_t left = request->count;
+        uint8_t* buffer = request->buffer;
+        while (left > 0) {
+            uint32_t chunk = left < VIRTIO_BLK_MAX_SECTORS ? left : VIRTIO_BLK_MAX_SECTORS;
+            uint32_t n = virtio_blk_segments(segments, (uint32_t)buffer, chunk * BLOCK_SECTOR_SIZE);
+            if (n == 0) {
+                request->status = -1;
+                break;
+            }
+            if (!virtio_blk_queue(type, lba, segments, n, request)) {
+                request->status = -1;
+                stalled = true;
+                break;
+            }
+            buffer += chunk * BLOCK_SECTOR_SIZE;
+            lba += chunk;
+            left -= chunk;
+        }
+    }
+    
+    if (stats.requests != queued) {
+        stats.batches++;
+    }
+    if (virtq_kick(&vdev, &queue)) {
+        stats.notifications++;
+    }
+    if (stalled || !virtio_blk_wait(0)) {
+        // The device stopped answering; nothing it still holds can be trusted
+        present = false;
+        for (uint32_t i = 0; i < count; i++) {
+            requests[i].status = -1;
+        }
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (requests[i].status < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int virtio_blk_read(block_device_t* dev, uint32_t lba, uint32_t count, void* buffer) {
+    block_request_t request = { lba, count, buffer, false, 0 };
+    return present ? virtio_blk_submit(dev, &request, 1) : -1;
+}
+
+static int virtio_blk_write(block_device_t* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    block_request_t request = { lba, count, (void*)buffer, true, 0 };
+    return present ? virtio_blk_submit(dev, &request, 1) : -1;
+}
+
+static int virtio_blk_flush(block_device_t* dev) {
+    (void)dev;
+    if (!present) {
+        return -1;
+    }
+    if (!(vdev.features & VIRTIO_BLK_F_FLUSH)) {
+        return 0; // No write cache: writes are done when they complete
+    }
+    
+    uint32_t errors = stats.errors;
+    if (!virtio_blk_queue(VIRTIO_BLK_T_FLUSH, 0, NULL, 0, NULL)) {
+        return -1;
+    }
+    if (virtq_kick(&vdev, &queue)) {
+        stats.notifications++;
+    }
+    if (!virtio_blk_wait(0)) {
+        present = false;
+        return -1;
+    }
+    return stats.errors == errors ? 0 : -1;
+}
+
+// Find the first virtio-blk device, set up its request queue and register
+// it as vda. Its interrupt is used when it lands on IRQ 9-11; otherwise,
+// and while interrupts are off, the waiter polls the used ring. Returns
+// the number of disks.
+uint32_t virtio_blk_init(void) {
+    pci_device_t* pci = pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_BLK_PCI_DEVICE);
+    if (!pci || !virtio_init_device(&vdev, pci, VIRTIO_BLK_F_FLUSH)) {
+        return 0;
+    }
+    if (!virtq_init(&vdev, &queue, 0)) {
+        outb(vdev.io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        return 0;
+    }
+    slots = kzalloc_tagged(queue.size * sizeof(virtio_blk_slot_t), MEM_TAG_DRIVERS);
+    if (!slots) {
+        outb(vdev.io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        return 0;
+    }
+    
+    // Capacity in 512-byte sectors, as 64 bits; the block layer takes 32
+    uint32_t capacity = virtio_config_read32(&vdev, 0);
+    if (virtio_config_read32(&vdev, 4)) {
+        capacity = 0xFFFFFFFF;
+    }
+    
+    if (vdev.irq >= 9 && vdev.irq <= 11) {
+        idt_set_gate(32 + vdev.irq, (uint32_t)virtio_irq_handler, 0x08, 0x8E);
+        outb(0xA1, inb(0xA1) & ~(1 << (vdev.irq - 8)));
+        outb(0x21, inb(0x21) & ~0x04);
+        irq_installed = true;
+    } else {
+        queue.avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+    }
+    virtio_driver_ok(&vdev);
+    
+    disk.name[0] = 'v';
+    disk.name[1] = 'd';
+    disk.name[2] = 'a';
+    disk.name[3] = '\0';
+    disk.sector_count = capacity;
+    disk.read = virtio_blk_read;
+    disk.write = virtio_blk_write;
+    disk.flush = virtio_blk_flush;
+    disk.submit = virtio_blk_submit;
+    disk.driver_data = &vdev;
+    if (blockdev_register(&disk) < 0) {
+        return 0;
+    }
+    present = true;
+    return 1;
+}
+
+bool virtio_blk_available(void) {
+    return present;
+}
+
+// Called from the IRQ stub. Reading the ISR status acknowledges the
+// interrupt; everything finished since the last pass is reaped at once.
+void virtio_blk_irq_handler(void) {
+    if (!present || !(virtio_read_isr(&vdev) & VIRTIO_ISR_QUEUE)) {
+        return;
+    }
+    stats.interrupts++;
+    virtio_blk_reap();
+}
+
+void virtio_blk_print_stats(void) {
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("virtio-blk:");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    if (!present) {
+        screen_println("  No virtio disk.");
+        return;
+    }
+    
+    screen_print("  Queue: ");
+    print_number(queue.size);
+    screen_print(" descriptors, IRQ ");
+    print_number(vdev.irq);
+    screen_println(irq_installed ? "" : " (polled)");
+    screen_print("  Requests: ");
+    print_number(stats.requests);
+    screen_print(" in ");
+    print_number(stats.batches);
+    screen_print(" batches, ");
+    print_number(stats.notifications);
+    screen_println(" notifications");
+    screen_print("  Completions: ");
+    print_number(stats.completions);
+    screen_print(" in ");
+    print_number(stats.reaps);
+    screen_print(" passes (most ");
+    print_number(stats.max_reaped);
+    screen_print("), ");
+    print_number(stats.interrupts);
+    screen_println(" interrupts");
+    screen_print("  Most in flight: ");
+    print_number(stats.max_in_flight);
+    screen_print(", errors: ");
+    print_number(stats.errors);
+    screen_println("");
+}
+
+// Benchmark
+#define VIRTIO_BENCH_REQUESTS 2048         // 4KB random reads per queue depth
+#define VIRTIO_BENCH_MAX_QD   32
+#define VIRTIO_BENCH_SPAN     65536        // Sectors the reads are spread over (32MB)
+
+// Average cycles per unit without 64-bit division
+static uint32_t cycles_each(uint64_t cycles, uint32_t count) {
+    while (cycles >> 32) {
+        cycles >>= 1;
+        count >>= 1;
+    }
+    return count ? (uint32_t)cycles / count : 0;
+}
+
+// Random 4KB reads handed to the block layer QD at a time, for QD from 1
+// to 32. Each batch costs one notification and completes as a whole.
+void virtio_blk_run_benchmark(void) {
+    if (!present) {
+        return;
+    }
+    
+    uint32_t span = disk.sector_count < VIRTIO_BENCH_SPAN ? disk.sector_count : VIRTIO_BENCH_SPAN;
+    span &= ~7u;
+    uint8_t* buffer = kmalloc_tagged(VIRTIO_BENCH_MAX_QD * FRAME_SIZE, MEM_TAG_DRIVERS);
+    block_request_t* requests = kmalloc_tagged(VIRTIO_BENCH_MAX_QD * sizeof(block_request_t), MEM_TAG_DRIVERS);
+    if (span == 0 || !buffer || !requests) {
+        kfree(buffer);
+        kfree(requests);
+        screen_println("Disk too small or out of memory.");
+        return;
+    }
+    
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_print("virtio-blk queue depth on ");
+    screen_print(disk.name);
+    screen_print(" (");
+    print_number(VIRTIO_BENCH_REQUESTS);
+    screen_println(" random 4KB reads each)");
+    screen_println("  QD    IOPS    MB/s  NOTIFY     IRQ");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    uint32_t seed = 0x2545F491;
+    for (uint32_t depth = 1; depth <= VIRTIO_BENCH_MAX_QD; depth *= 2) {
+        uint32_t notifications = stats.notifications;
+        uint32_t interrupts = stats.interrupts;
+        bool failed = false;
+        uint64_t start = rdtsc();
+        for (uint32_t done = 0; done < VIRTIO_BENCH_REQUESTS && !failed; done += depth) {
+            for (uint32_t i = 0; i < depth; i++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                requests[i].lba = (seed % (span / 8)) * 8;
+                requests[i].count = 8;
+                requests[i].buffer = buffer + i * FRAME_SIZE;
+                requests[i].write = false;
+            }
+            failed = blockdev_submit(&disk, requests, depth) < 0;
+        }
+        uint64_t elapsed = rdtsc() - start;
+        if (failed) {
+            screen_println("  Read failed.");
+            break;
+        }
+        
+        uint32_t us = cycles_each(elapsed, timer_tsc_per_ms() / 1000);
+        uint32_t iops = us >= 100 ? VIRTIO_BENCH_REQUESTS * 10000 / (us / 100) : 0;
+        uint32_t tenths = us ? VIRTIO_BENCH_REQUESTS * FRAME_SIZE * 10 / us : 0;
+        print_column(depth, "", 4);
+        print_column(iops, "", 8);
+        print_column(tenths / 10, ".", 7);
+        print_number(tenths % 10);
+        print_column(stats.notifications - notifications, "", 8);
+        print_column(stats.interrupts - interrupts, "", 8);
+        screen_println("");
+    }
+    
+    kfree(buffer);
+    kfree(requests);
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
+
+// Right-align num plus suffix in a column of the given width
+static void print_column(uint32_t num, const char* suffix, uint32_t width) {
+    uint32_t length = 1;
+    for (uint32_t n = num; n >= 10; n /= 10) {
+        length++;
+    }
+    for (const char* c = suffix; *c; c++) {
+        length++;
+    }
+    for (; length < width; length++) {
+        screen_print(" ");
+    }
+    print_number(num);
+    screen_print(suffix);
+}
@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "types.h"
+
+// Bump-pointer arena constants
+#define ARENA_ALIGN         16
+#define ARENA_DEFAULT_CHUNK 4096
+
+// Chunks are kmalloc'd and chained; allocation only moves a pointer
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    uint32_t size;             // Usable bytes in data[]
+    uint32_t used;
+    uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+// Objects in an arena are never freed individually; arena_reset drops them
+// all at once and keeps the first chunk for the next round
+typedef struct {
+    arena_chunk_t* head;
+    arena_chunk_t* current;
+    uint32_t chunk_size;
+    uint32_t peak;             // Most bytes handed out between two resets
+} arena_t;
+
+// Function prototypes
+void arena_init(arena_t* arena, uint32_t chunk_size);
+void* arena_alloc(arena_t* arena, uint32_t size);
+char* arena_strndup(arena_t* arena, const char* str, uint32_t length);
+uint32_t arena_used(const arena_t* arena);
+void arena_reset(arena_t* arena);
+void arena_destroy(arena_t* arena);
+
+#endif // ARENA_H
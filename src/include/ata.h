@@ -0,0 +1,88 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "types.h"
+#include "blockdev.h"
+
+// Legacy IDE channels
+#define ATA_PRIMARY_IO      0x1F0
+#define ATA_PRIMARY_CTRL    0x3F6
+#define ATA_SECONDARY_IO    0x170
+#define ATA_SECONDARY_CTRL  0x376
+
+// Registers, as offsets from a channel's I/O base
+#define ATA_REG_DATA        0
+#define ATA_REG_ERROR       1
+#define ATA_REG_SECCOUNT    2
+#define ATA_REG_LBA0        3
+#define ATA_REG_LBA1        4
+#define ATA_REG_LBA2        5
+#define ATA_REG_DRIVE       6
+#define ATA_REG_STATUS      7
+#define ATA_REG_COMMAND     7
+
+// Status register bits
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DRDY         0x40
+#define ATA_SR_DF           0x20
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+
+// Commands
+#define ATA_CMD_READ_PIO    0x20
+#define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_READ_DMA    0xC8
+#define ATA_CMD_WRITE_DMA   0xCA
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY    0xEC
+
+#define ATA_CTRL_NIEN       0x02       // Device control: no interrupts, we poll
+#define ATA_MAX_SECTORS     256        // Per LBA28 command (a count of 0 means 256)
+#define ATA_LBA28_LIMIT     0x10000000
+#define ATA_TIMEOUT         1000000    // Status polls before giving up
+
+// Bus-master IDE registers, as offsets from a channel's base in BAR4
+#define ATA_BM_COMMAND      0
+#define ATA_BM_STATUS       2
+#define ATA_BM_PRDT         4
+#define ATA_BM_CHANNEL_SIZE 8          // The secondary channel's registers follow the primary's
+
+#define ATA_BM_CMD_START    0x01
+#define ATA_BM_CMD_READ     0x08       // Direction: device to memory
+#define ATA_BM_SR_ACTIVE    0x01
+#define ATA_BM_SR_ERR       0x02
+#define ATA_BM_SR_IRQ       0x04       // Set when the drive raised its interrupt; write 1 to clear
+
+// Physical region descriptor: one physically contiguous piece of a DMA
+// transfer. Regions may not cross a 64KB boundary; a count of 0 means 64KB.
+typedef struct {
+    uint32_t address;
+    uint16_t bytes;
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+#define ATA_PRD_EOT         0x8000     // Last region of the table
+#define ATA_PRD_ENTRIES     32
+#define ATA_DMA_MAX_SECTORS 128        // 64KB per command, so a page-by-page PRDT always fits
+#define ATA_PRIMARY_IRQ     14
+#define ATA_SECONDARY_IRQ   15
+#define ATA_DMA_TIMEOUT_MS  1000
+
+typedef struct {
+    uint16_t io;
+    uint16_t ctrl;
+    uint16_t bmide;                    // Bus-master registers; 0 when DMA is unavailable
+    uint8_t channel;
+    uint8_t slave;
+    char model[41];
+    block_device_t dev;
+} ata_drive_t;
+
+// Function prototypes
+uint32_t ata_init(void);
+const char* ata_get_model(uint32_t drive);
+bool ata_dma_available(void);
+void ata_irq_handler(uint32_t channel);
+void ata_run_benchmark(void);
+
+#endif // ATA_H
@@ -0,0 +1,59 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "types.h"
+#include "blockdev.h"
+
+#define BCACHE_BUFFERS        256      // Cached sectors (128KB)
+#define BCACHE_GROUP_BUFFERS  8        // Buffers sharing one page of sector data
+#define BCACHE_GROUPS         (BCACHE_BUFFERS / BCACHE_GROUP_BUFFERS)
+#define BCACHE_MIN_GROUPS     4        // Pages the shrinker always leaves (one batch)
+#define BCACHE_HASH_BUCKETS   512      // A power of two
+#define BCACHE_BATCH          32       // Most sectors moved by one device command
+#define BCACHE_READAHEAD_MIN  4        // First read-ahead window once a stream is seen
+#define BCACHE_SYNC_RUNS      8        // Write-back runs bcache_sync submits as one batch
+
+// Buffer flags
+#define BUF_VALID     0x01             // Holds the sector's contents
+#define BUF_DIRTY     0x02             // Changed since it was last written back
+#define BUF_READAHEAD 0x04             // Loaded ahead of use and not yet read
+
+// One cached sector. Buffers returned by bcache_read/bcache_get are pinned
+// until bcache_release and are never evicted while pinned.
+typedef struct buffer {
+    block_device_t* dev;
+    uint32_t lba;
+    uint8_t* data;                     // NULL while the shrinker has its group's page
+    uint16_t flags;
+    uint16_t refcount;
+    struct buffer* hash_next;
+    struct buffer* lru_prev;           // Toward the most recently used
+    struct buffer* lru_next;
+} buffer_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readahead_sectors;        // Loaded by read-ahead
+    uint32_t readahead_used;           // Of those, later read
+    uint32_t evictions;
+    uint32_t writeback_sectors;
+    uint32_t writeback_commands;
+    uint32_t dirty;                    // Dirty buffers right now
+    uint32_t resident;                 // Buffers with a page behind them right now
+    uint32_t shrunk_groups;            // Pages handed back to the shrinker
+} bcache_stats_t;
+
+// Function prototypes
+bool bcache_init(void);
+buffer_t* bcache_read(block_device_t* dev, uint32_t lba);
+buffer_t* bcache_get(block_device_t* dev, uint32_t lba);
+void bcache_mark_dirty(buffer_t* buffer);
+void bcache_release(buffer_t* buffer);
+int bcache_sync(block_device_t* dev);
+void bcache_invalidate(block_device_t* dev);
+void bcache_get_stats(bcache_stats_t* stats);
+void bcache_print_stats(void);
+void bcache_run_benchmark(block_device_t* dev);
+
+#endif // BCACHE_H
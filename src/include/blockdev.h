@@ -0,0 +1,52 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include "types.h"
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCKDEV_MAX      8
+
+// One transfer in a batch handed to blockdev_submit
+typedef struct {
+    uint32_t lba;
+    uint32_t count;
+    void* buffer;
+    bool write;
+    int status;                              // 0 once done, -1 if it failed
+} block_request_t;
+
+// A disk as the rest of the kernel sees it. Drivers fill in the geometry
+// and operations and register the device; read and write move whole
+// sectors and return 0 on success or -1 on a device error.
+typedef struct block_device {
+    char name[8];
+    uint32_t sector_count;
+    int (*read)(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+    int (*write)(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+    int (*flush)(struct block_device* dev);  // Drain the device's write cache
+    
+    // Optional: run a batch of requests together, returning once all are
+    // done. Requests arrive with status 0, or -1 if they failed the range
+    // check and must be skipped. Devices without it get them one at a time.
+    int (*submit)(struct block_device* dev, block_request_t* requests, uint32_t count);
+    void* driver_data;
+    uint32_t index;                          // Position in the registry
+    
+    // Traffic that reached the driver
+    uint32_t read_commands;
+    uint32_t write_commands;
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+} block_device_t;
+
+// Function prototypes
+int blockdev_register(block_device_t* dev);
+uint32_t blockdev_count(void);
+block_device_t* blockdev_get(uint32_t index);
+int blockdev_read(block_device_t* dev, uint32_t lba, uint32_t count, void* buffer);
+int blockdev_write(block_device_t* dev, uint32_t lba, uint32_t count, const void* buffer);
+int blockdev_flush(block_device_t* dev);
+int blockdev_submit(block_device_t* dev, block_request_t* requests, uint32_t count);
+void blockdev_print_devices(void);
+
+#endif // BLOCKDEV_H
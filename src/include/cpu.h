@@ -0,0 +1,87 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "types.h"
+
+// CPUID leaf 1 feature bits (EDX)
+#define CPUID_FEAT_EDX_TSC      (1 << 4)
+#define CPUID_FEAT_EDX_PSE      (1 << 3)
+#define CPUID_FEAT_EDX_PGE      (1 << 13)
+#define CPUID_FEAT_EDX_FXSR     (1 << 24)
+#define CPUID_FEAT_EDX_SSE      (1 << 25)
+#define CPUID_FEAT_EDX_SSE2     (1 << 26)
+
+// Control register bits
+#define CR0_MP                  (1 << 1)
+#define CR0_EM                  (1 << 2)
+#define CR0_WP                  (1 << 16)
+#define CR0_PG                  (1u << 31)
+#define CR4_PSE                 (1 << 4)
+#define CR4_PGE                 (1 << 7)
+#define CR4_OSFXSR              (1 << 9)
+#define CR4_OSXMMEXCPT          (1 << 10)
+
+// Function prototypes
+void cpu_init(void);
+bool cpu_has_sse2(void);
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t value;
+    asm volatile ("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value) {
+    asm volatile ("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint32_t read_cr2(void) {
+    uint32_t value;
+    asm volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t value;
+    asm volatile ("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr3(uint32_t value) {
+    asm volatile ("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t value;
+    asm volatile ("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value) {
+    asm volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+// Save and restore the x87/SSE register state (512 bytes, 16-byte aligned)
+static inline void fxsave(void* area) {
+    asm volatile ("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+static inline void fxrstor(const void* area) {
+    asm volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+static inline void invlpg(uint32_t addr) {
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+#endif // CPU_H
@@ -2,12 +2,32 @@
 #define FILESYSTEM_H
 
 #include "types.h"
+#include "blockdev.h"
+#include "initrd.h"
 
 // File system constants
-#define MAX_FILES 32
 #define MAX_FILENAME_LENGTH 16
-#define MAX_FILE_SIZE 1024
 #define FS_BLOCK_SIZE 512
+#define FS_GROUP_BLOCKS 64     // Blocks added each time the store grows (32KB)
+#define FS_MAX_FILE_BYTES 0x80000000
+#define FS_INITIAL_FILES 32    // File table slots at boot; the table doubles and halves from here
+#define FS_DCACHE_SIZE 128     // Dentry cache entries; a power of two
+#define FS_DCACHE_REFILL_FREE 0x10000 // Free heap bytes fs_idle wants before rebuilding it
+#define FS_PATH_MAX 64         // Longer paths are resolved without the dentry cache
+#define FS_ROOT_DIR (-1)       // Parent of entries in the root directory
+#define FS_NO_ENTRY (-2)       // Path lookup found nothing
+
+// Disk image: store block n in sector FS_DISK_DATA_LBA + n, then the
+// entries and their block lists somewhere past the data. Blocks are the
+// size of a sector, so one maps onto the other. Two superblocks, in the
+// first and last sectors, each describe a whole image; a sync writes the
+// new image clear of the current one and only then overwrites the older
+// superblock, so a crash at any point leaves a complete image.
+#define FS_DISK_MAGIC "TRAKFS01"
+#define FS_DISK_VERSION 2      // Version 1 had only the first superblock
+#define FS_DISK_DATA_LBA 1
+#define FS_DISK_SLOTS 2
+#define FS_SYNC_DELAY_MS 2000  // How long a change may wait before the idle loop writes it back
 
 // File types
 #define FILE_TYPE_REGULAR 1
@@ -19,28 +39,124 @@
 #define FILE_PERM_EXECUTE 0x04
 
 // File system structures
-typedef struct {
+typedef struct file_entry {
     char name[MAX_FILENAME_LENGTH];
     uint8_t type;
     uint8_t permissions;
     uint32_t size;
-    uint32_t data_offset;  // Offset in data area
+    uint32_t* blocks;      // Store block holding each FS_BLOCK_SIZE piece of the file
+    uint32_t block_count;
+    uint32_t block_capacity;
+    struct file_entry* share_next; // Ring of clones using the same blocks array; itself if none
     uint32_t created_time; // Timestamp
-    bool in_use;
+    uint32_t name_hash;    // Hash of parent and name, checked before comparing strings
+    int hash_next;         // Next slot in the same bucket, -1 at the end
+    int parent;            // Slot of the containing directory, or FS_ROOT_DIR
+    uint32_t child_count;  // Entries inside this directory
+    uint32_t id;           // Never reused, so stale dentries can be detected
 } file_entry_t;
 
+// Superblock, written after everything else. The checksum catches
+// metadata left half-written by an interrupted sync.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t table_slots;
+    uint32_t file_count;
+    uint32_t total_blocks;
+    uint32_t meta_lba;
+    uint32_t meta_bytes;
+    uint32_t checksum;     // FNV-1a over the metadata
+    uint32_t sequence;     // Higher in each newer image; 0 in version 1
+} fs_disk_super_t;
+
+// Entry as stored on disk; the block lists follow all entries, in order
 typedef struct {
-    uint32_t total_files;
+    char name[MAX_FILENAME_LENGTH];
+    int32_t slot;
+    int32_t parent;
+    uint32_t size;
+    uint32_t created_time;
+    uint32_t block_count;
+    uint8_t type;
+    uint8_t permissions;
+    uint8_t reserved[26];  // Pads the entry to 64 bytes
+} fs_disk_entry_t;
+
+// Dentry cache entry: a full path and the slot it resolved to. A negative
+// entry (slot FS_NO_ENTRY) records a path that did not exist.
+typedef struct {
+    uint32_t hash;
+    int slot;
+    uint32_t id;           // File id, or create_generation for a negative entry
+    uint8_t length;        // 0 for an unused entry
+    char path[FS_PATH_MAX];
+} dentry_t;
+
+typedef struct {
+    uint32_t total_files;            // Slots in the file table
     uint32_t used_files;
-    uint32_t total_size;
-    uint32_t used_size;
-    file_entry_t files[MAX_FILES];
-    uint8_t data_area[MAX_FILES * MAX_FILE_SIZE];
+    uint32_t total_size;             // Bytes in the block store
+    uint32_t used_size;              // Bytes of file data
+    file_entry_t** files;            // NULL for free slots; entries come from a slab cache
+    int* free_next;                  // Free slots chained from free_head
+    int free_head;
+    int* hash_heads;                 // First slot in each name bucket, -1 if empty
+    uint32_t hash_buckets;           // Twice total_files, so a power of two
+    uint32_t upper_used;             // Used slots in the top half of the table
+    
+    // Block store: groups of FS_GROUP_BLOCKS blocks, allocated as files
+    // need them, with one bitmap bit per block
+    uint8_t** block_groups;
+    uint32_t* block_bitmap;
+    uint32_t group_count;
+    uint32_t group_capacity;
+    uint32_t total_blocks;
+    uint32_t used_blocks;
+    uint32_t block_hint;             // Bitmap word the next search starts at
+    uint32_t* block_shares;          // Per block: how many more block lists hold it
+    uint32_t clones;                 // Files created by fs_clone_file
+    uint32_t cow_copies;             // Shared blocks copied because one holder wrote to them
+    uint32_t image_copies;           // Blocks copied because an image on disk uses them
+    
+    // Dentry cache over resolved paths; NULL while a shrinker has it
+    dentry_t* dcache;
+    uint32_t next_id;
+    uint32_t create_generation;      // Bumped by every create; expires negative dentries
+    uint32_t dcache_hits;
+    uint32_t dcache_negative_hits;
+    uint32_t dcache_misses;
+    
+    // Backing disk, NULL while the file system lives only in memory
+    block_device_t* disk;
+    uint32_t* dirty_bitmap;          // Store blocks written since the last sync
+    uint32_t* image_bitmap;          // Per bitmap word, one word per superblock slot:
+                                     // blocks that slot's image uses, never reused or
+                                     // written in place until the slot is rewritten
+    uint32_t image_slot;             // Slot holding the newest image
+    uint32_t image_sequence;
+    uint32_t meta_start[FS_DISK_SLOTS]; // Sectors holding each image's metadata
+    uint32_t meta_end[FS_DISK_SLOTS];
+    bool sync_pending;               // Anything at all changed since the last sync
+    uint64_t dirty_since;            // TSC at the oldest unsynced change
+    uint32_t syncs;
 } filesystem_t;
 
-// File handle for operations
+// Read-only window onto file bytes inside the block store. Views stay
+// valid until the file is written to or deleted.
+typedef struct {
+    const uint8_t* data;
+    uint32_t length;
+} fs_view_t;
+
+#define FS_VIEW_BATCH 8        // Views callers typically ask for per call
+
+// File handle for operations. Files found only in the initrd have no
+// slot; the handle points at their entry in the image instead.
 typedef struct {
     int file_index;
+    uint32_t file_id;      // Id of the file when opened; a reused slot won't match
+    const initrd_entry_t* initrd;
     uint32_t position;
     bool is_open;
 } file_handle_t;
@@ -48,10 +164,15 @@ typedef struct {
 // File system functions
 void fs_init(void);
 void fs_print_info(void);
+int fs_sync(void);
+bool fs_idle(void);
+bool fs_is_persistent(void);
+const char* fs_disk_name(void);
 
 // File operations
 int fs_create_file(const char* name, uint8_t type);
 int fs_delete_file(const char* name);
+int fs_clone_file(const char* src, const char* dst);
 file_handle_t* fs_open_file(const char* name);
 void fs_close_file(file_handle_t* handle);
 
@@ -59,14 +180,16 @@ void fs_close_file(file_handle_t* handle);
 int fs_read_file(file_handle_t* handle, void* buffer, uint32_t size);
 int fs_write_file(file_handle_t* handle, const void* buffer, uint32_t size);
 int fs_seek_file(file_handle_t* handle, uint32_t position);
+int fs_read_view(file_handle_t* handle, uint32_t size, fs_view_t* views, uint32_t max_views);
 
 // Directory operations
-void fs_list_files(void);
+void fs_list_files(const char* path);
 bool fs_file_exists(const char* name);
 uint32_t fs_get_file_size(const char* name);
 
 // Utility functions
 const char* fs_get_type_string(uint8_t type);
 uint32_t fs_get_free_space(void);
+void fs_run_benchmark(void);
 
 #endif
\ No newline at end of file
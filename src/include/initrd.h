@@ -0,0 +1,51 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include "types.h"
+#include "multiboot.h"
+
+// Initial ramdisk: read-only files packed by tools/mkinitrd and loaded by
+// GRUB as a multiboot module. The image is used where it lies. Its header
+// points at a hash table over full paths, so mounting checks the header
+// alone and a lookup reads one bucket, however many files there are.
+//
+//   header | buckets (uint32_t each) | entries | paths and file data
+#define INITRD_MAGIC        "TRAKRD01"
+#define INITRD_VERSION      1
+#define INITRD_NONE         0xFFFFFFFF // Empty bucket, end of a chain, no parent
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t image_size;               // Bytes, header included
+    uint32_t entry_count;
+    uint32_t bucket_count;             // A power of two
+    uint32_t buckets_offset;
+    uint32_t entries_offset;
+} initrd_header_t;
+
+typedef struct {
+    uint32_t hash;                     // FNV-1a of the path
+    uint32_t next;                     // Next entry in the bucket
+    uint32_t parent;                   // Entry of the containing directory, INITRD_NONE at the root
+    uint32_t path_offset;              // Path without leading '/', not terminated
+    uint32_t data_offset;
+    uint32_t size;
+    uint16_t path_length;
+    uint16_t name_start;               // Offset of the last component within the path
+    uint8_t type;                      // FILE_TYPE_REGULAR or FILE_TYPE_DIRECTORY
+    uint8_t reserved[3];
+} initrd_entry_t;
+
+// Function prototypes
+bool initrd_init(multiboot_info_t* mbi);
+bool initrd_available(void);
+uint32_t initrd_entry_count(void);
+uint32_t initrd_image_size(void);
+const initrd_entry_t* initrd_lookup(const char* path, uint32_t length);
+const initrd_entry_t* initrd_get_entry(uint32_t index);
+uint32_t initrd_index(const initrd_entry_t* entry);
+const uint8_t* initrd_data(const initrd_entry_t* entry);
+const char* initrd_name(const initrd_entry_t* entry, uint32_t* length);
+
+#endif // INITRD_H
@@ -24,4 +24,23 @@ static inline uint16_t inw(uint16_t port) {
     return data;
 }
 
+static inline void outl(uint16_t port, uint32_t data) {
+    asm volatile ("outl %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t data;
+    asm volatile ("inl %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+// Move count 16-bit words between a data port and memory
+static inline void insw(uint16_t port, void* buffer, uint32_t count) {
+    asm volatile ("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buffer, uint32_t count) {
+    asm volatile ("rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
 #endif // IO_H
\ No newline at end of file
@@ -2,13 +2,15 @@
 #define KERNEL_H
 
 #include "types.h"
+#include "multiboot.h"
 
 // Kernel constants
 #define KERNEL_VERSION "TRAKOS v1.0"
 
 // Function prototypes
-void kernel_main(void);
+void kernel_main(uint32_t magic, multiboot_info_t* mbi);
 void kernel_panic(const char* message);
 void safe_mode_test(void);
+bool kernel_idle(void);
 
 #endif // KERNEL_H
\ No newline at end of file
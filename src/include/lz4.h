@@ -0,0 +1,23 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "types.h"
+
+// LZ4 block format: sequences of [token][literals][offset][match length]
+// with no frame header or checksum. Offsets are 16 bits, so one call
+// compresses at most LZ4_MAX_INPUT bytes.
+#define LZ4_MAX_INPUT       0x10000
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5          // The block always ends in this many literals
+#define LZ4_MF_LIMIT        12         // No match may start closer than this to the end
+#define LZ4_HASH_BITS       12
+#define LZ4_SKIP_TRIGGER    6          // Misses before the search starts skipping
+
+// Worst-case compressed size of n input bytes
+#define LZ4_BOUND(n)        ((n) + (n) / 255 + 16)
+
+// Function prototypes
+uint32_t lz4_compress(const uint8_t* src, uint32_t length, uint8_t* dst, uint32_t capacity);
+int32_t lz4_decompress(const uint8_t* src, uint32_t length, uint8_t* dst, uint32_t capacity);
+
+#endif // LZ4_H
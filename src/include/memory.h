@@ -2,34 +2,138 @@
 #define MEMORY_H
 
 #include "types.h"
+#include "string.h"
 
 // Memory constants
 #define PAGE_SIZE           4096
-#define HEAP_START          0x400000   // 4MB
-#define HEAP_SIZE           0x400000   // 4MB heap
-#define HEAP_END            (HEAP_START + HEAP_SIZE)
+#define HEAP_INITIAL_SIZE   0x100000   // 1MB taken from the frame allocator at boot
+#define HEAP_GROW_MIN       0x40000    // Grow by at least 256KB at a time
+#define HEAP_ZERO_POOL      0x80000    // Keep up to 512KB of the top block pre-zeroed
+#define HEAP_LARGE_THRESHOLD PAGE_SIZE // Requests this big get whole frames of their own
+#define HEAP_CACHE_LINE     64         // Alignment that keeps objects off each other's lines
 
-// Memory block structure
+// Size-class bins: exact 16-byte classes below HEAP_SMALL_LIMIT,
+// one power-of-two class per bin above it
+#define HEAP_BIN_STEP       16
+#define HEAP_SMALL_LIMIT    512
+#define HEAP_SMALL_BINS     (HEAP_SMALL_LIMIT / HEAP_BIN_STEP)
+#define HEAP_LARGE_BINS     32
+#define HEAP_NUM_BINS       (HEAP_SMALL_BINS + HEAP_LARGE_BINS)
+
+// Block header. Every block is [header][payload][footer]; the header and
+// footer carry the same boundary tag so both neighbours are found by address.
+// The free-list links overlay the payload and are only valid while free.
 typedef struct memory_block {
-    uint32_t size;
-    bool is_free;
-    struct memory_block* next;
-    struct memory_block* prev;
+    uint32_t size;                   // Payload size in bytes
+    uint16_t is_free;
+    uint16_t tag;                    // Owner of an allocated block (mem_tag_t)
+    struct memory_block* next_free;  // Blocks in the same bin
+    struct memory_block* prev_free;
 } memory_block_t;
 
+// Boundary tag at the end of every block
+typedef struct {
+    uint32_t size;
+    uint32_t is_free;
+} memory_footer_t;
+
+#define HEAP_HEADER_SIZE    8          // size + is_free + tag
+#define HEAP_FOOTER_SIZE    sizeof(memory_footer_t)
+#define HEAP_OVERHEAD       (HEAP_HEADER_SIZE + HEAP_FOOTER_SIZE)
+
+// Every allocation is charged to a subsystem tag. kmalloc and friends use
+// the current tag, which callers switch with memory_set_tag around work
+// done on a subsystem's behalf; the _tagged variants name one directly.
+// krealloc keeps the tag the block was allocated with.
+typedef enum {
+    MEM_TAG_KERNEL = 0,
+    MEM_TAG_SHELL,
+    MEM_TAG_FS,
+    MEM_TAG_DRIVERS,
+    MEM_TAG_ZRAM,
+    MEM_TAG_COUNT
+} mem_tag_t;
+
+typedef struct {
+    const char* name;
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t allocs;
+    uint32_t frees;
+} mem_tag_stats_t;
+
+// Shrinkers release reclaimable memory when kmalloc would otherwise fail.
+// They are asked in ascending priority order and return the number of bytes
+// they gave back (to the heap or to the frame allocator). A shrinker must
+// not allocate. Code that may have interrupted one, such as the page fault
+// handler, allocates with kmalloc_atomic, which never runs them.
+#define SHRINKER_MAX            8
+#define SHRINKER_PRIORITY_CACHE 10     // Caches that refill cheaply
+#define SHRINKER_PRIORITY_DATA  20     // Data that is expensive to rebuild
+
+typedef uint32_t (*shrinker_fn_t)(uint32_t wanted);
+
+typedef struct {
+    const char* name;
+    shrinker_fn_t shrink;
+    uint32_t priority;
+    uint32_t calls;
+    uint32_t released;               // Bytes released over all calls
+} shrinker_t;
+
+// Statistics are kept per power-of-two class: 16-31, 32-63, ... bytes
+#define HEAP_STAT_CLASSES   28
+
+// Snapshot of the heap counters. The per-class alloc/free counts and the
+// peaks are maintained on every call; the free-block figures are gathered
+// from the bins when the snapshot is taken.
+typedef struct {
+    uint32_t alloc_calls;
+    uint32_t free_calls;
+    uint32_t failed_allocs;
+    uint32_t search_steps;           // Free blocks inspected by kmalloc
+    uint32_t peak_used;
+    uint32_t zero_hits;              // kzalloc calls served entirely from zeroed memory
+    uint32_t zero_misses;            // kzalloc calls that had to clear some bytes
+    uint32_t zero_pool;              // Bytes of the top block currently pre-zeroed
+    uint32_t reclaim_runs;           // Times kmalloc fell back to the shrinkers
+    uint32_t reclaimed;              // Bytes the shrinkers released
+    uint32_t large_allocs;           // Requests served with whole frames
+    uint32_t large_live;             // Page-direct allocations not yet freed
+    uint32_t large_bytes;            // Frames held by them, in bytes
+    uint32_t free_blocks;
+    uint32_t free_bytes;
+    uint32_t largest_free;
+    uint32_t class_allocs[HEAP_STAT_CLASSES];
+    uint32_t class_frees[HEAP_STAT_CLASSES];
+    uint32_t class_free_blocks[HEAP_STAT_CLASSES];
+} heap_stats_t;
+
 // Function prototypes
 void memory_init(void);
 void* kmalloc(uint32_t size);
 void kfree(void* ptr);
 void* krealloc(void* ptr, uint32_t new_size);
+void* kzalloc(uint32_t size);
+void* kcalloc(uint32_t count, uint32_t size);
+void* kmalloc_aligned(uint32_t size, uint32_t align);
+void* kmalloc_tagged(uint32_t size, mem_tag_t tag);
+void* kzalloc_tagged(uint32_t size, mem_tag_t tag);
+void* kmalloc_atomic(uint32_t size, mem_tag_t tag);
+mem_tag_t memory_set_tag(mem_tag_t tag);
+void memory_get_tag_stats(mem_tag_t tag, mem_tag_stats_t* stats);
+void memory_print_tag_stats(void);
+uint32_t ksize(void* ptr);
+bool memory_idle(void);
+uint32_t memory_trim(void);
+bool memory_register_shrinker(const char* name, shrinker_fn_t shrink, uint32_t priority);
+void memory_unregister_shrinker(shrinker_fn_t shrink);
+void memory_run_shrink_test(void);
 uint32_t memory_get_total(void);
 uint32_t memory_get_used(void);
 uint32_t memory_get_free(void);
 void memory_print_stats(void);
-
-// Utility functions
-void* memcpy(void* dest, const void* src, uint32_t n);
-void* memset(void* ptr, int value, uint32_t n);
-int memcmp(const void* ptr1, const void* ptr2, uint32_t n);
+void memory_get_stats(heap_stats_t* stats);
+void memory_print_heap_stats(void);
 
 #endif // MEMORY_H
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "types.h"
+
+// Value left in EAX by a multiboot-compliant bootloader
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+
+// multiboot_info_t flags
+#define MULTIBOOT_INFO_MEMORY       0x00000001
+#define MULTIBOOT_INFO_MODS         0x00000008
+#define MULTIBOOT_INFO_MEM_MAP      0x00000040
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE  1
+
+// Boot information passed by the bootloader in EBX
+typedef struct {
+    uint32_t flags;
+    uint32_t mem_lower;        // KB below 1MB
+    uint32_t mem_upper;        // KB above 1MB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed)) multiboot_info_t;
+
+// Boot module loaded alongside the kernel; mods_addr points at an array
+// of mods_count of these
+typedef struct {
+    uint32_t mod_start;
+    uint32_t mod_end;          // One past the last byte
+    uint32_t cmdline;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
+// Memory map entry; 'size' does not include the size field itself
+typedef struct {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+#endif // MULTIBOOT_H
@@ -0,0 +1,40 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "types.h"
+
+// Page directory / page table entry flags
+#define PAGE_PRESENT        0x001
+#define PAGE_WRITABLE       0x002
+#define PAGE_USER           0x004
+#define PAGE_WRITE_THROUGH  0x008
+#define PAGE_CACHE_DISABLE  0x010
+#define PAGE_ACCESSED       0x020
+#define PAGE_DIRTY          0x040
+#define PAGE_LARGE          0x080   // PDE maps a 4MB page (PSE)
+#define PAGE_GLOBAL         0x100
+
+#define PAGE_FRAME_MASK     0xFFFFF000
+#define LARGE_PAGE_SIZE     0x400000
+#define LARGE_PAGE_MASK     0xFFC00000
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT  0x01
+#define PAGE_FAULT_WRITE    0x02
+
+// Virtual window used by the 4KB side of the TLB benchmark
+#define PAGING_BENCH_WINDOW 0xD0000000
+
+// Function prototypes
+void paging_init(void);
+bool paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags);
+bool paging_map_large(uint32_t virt, uint32_t phys, uint32_t flags);
+bool paging_map_range(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags);
+void paging_unmap(uint32_t virt);
+uint32_t* paging_get_pte(uint32_t virt, bool create);
+uint32_t paging_get_physical(uint32_t virt);
+bool paging_large_pages_enabled(void);
+void paging_fault_handler(uint32_t error, uint32_t address, uint32_t eip);
+void paging_run_benchmark(void);
+
+#endif // PAGING_H
@@ -0,0 +1,63 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "types.h"
+
+// Configuration mechanism #1: write an address, then access the data port
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+#define PCI_MAX_DEVICES     32
+
+// Configuration space offsets
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_CAPABILITIES    0x34
+#define PCI_INTERRUPT_LINE  0x3C
+
+// Command register bits
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_BUS_MASTER  0x0004
+
+#define PCI_BAR_IO              0x01   // Bit 0 of a BAR: I/O space rather than memory
+#define PCI_HEADER_MULTIFUNC    0x80
+
+// Classes the kernel has drivers for
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_SUBCLASS_IDE        0x01
+
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t irq_line;
+    uint32_t bar[6];
+} pci_device_t;
+
+// Function prototypes
+void pci_init(void);
+uint32_t pci_device_count(void);
+pci_device_t* pci_get_device(uint32_t index);
+pci_device_t* pci_find_class(uint8_t class_code, uint8_t subclass);
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id);
+uint32_t pci_config_read32(const pci_device_t* dev, uint8_t offset);
+uint16_t pci_config_read16(const pci_device_t* dev, uint8_t offset);
+uint8_t pci_config_read8(const pci_device_t* dev, uint8_t offset);
+void pci_config_write32(const pci_device_t* dev, uint8_t offset, uint32_t value);
+void pci_config_write16(const pci_device_t* dev, uint8_t offset, uint16_t value);
+void pci_enable(const pci_device_t* dev, uint16_t bits);
+void pci_print_devices(void);
+
+#endif // PCI_H
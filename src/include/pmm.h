@@ -0,0 +1,23 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include "types.h"
+#include "multiboot.h"
+
+// Physical memory constants
+#define FRAME_SIZE          4096
+#define PMM_MAX_FRAMES      0x100000   // 4GB of 4KB frames
+#define PMM_LOW_MEMORY      0x100000   // Never hand out frames below 1MB
+
+// Function prototypes
+void pmm_init(multiboot_info_t* mbi);
+uint32_t pmm_alloc_frame(void);
+uint32_t pmm_alloc_frames(uint32_t count);
+void pmm_free_frame(uint32_t addr);
+void pmm_free_frames(uint32_t addr, uint32_t count);
+void pmm_reserve_range(uint32_t start, uint32_t end);
+uint32_t pmm_get_total_frames(void);
+uint32_t pmm_get_free_frames(void);
+uint32_t pmm_get_memory_end(void);
+
+#endif // PMM_H
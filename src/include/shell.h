@@ -4,6 +4,8 @@
 #include "types.h"
 
 #define SHELL_BUFFER_SIZE 256
+#define SHELL_ARENA_CHUNK 4096   // Per-command scratch arena, grown on demand
+#define SHELL_EDIT_LIMIT 4096    // Characters the line editor accepts per file
 
 // Function prototypes
 void shell_init(void);
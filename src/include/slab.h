@@ -0,0 +1,52 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "types.h"
+
+// Slab allocator constants
+#define SLAB_CACHE_LINE     64
+#define SLAB_MIN_ALIGN      8
+#define SLAB_MAX_CACHES     16
+#define SLAB_MAX_OBJECT     512        // Objects per page stay >= 8
+#define SLAB_END            0xFFFF     // Terminates a slab's free index chain
+
+// Optional constructor, run once per object when its slab is created.
+// Objects must be returned to the cache in their constructed state.
+typedef void (*kmem_ctor_t)(void* object);
+
+struct kmem_cache;
+
+// One page of objects; the header and free index live at the start of the
+// page and the objects begin on the next cache line
+typedef struct slab {
+    struct slab* next;
+    struct slab* prev;
+    struct kmem_cache* cache;
+    uint8_t* objects;
+    uint16_t free_head;        // First free object, or SLAB_END
+    uint16_t in_use;
+    uint16_t free_index[];     // Next free object after each free object
+} slab_t;
+
+typedef struct kmem_cache {
+    const char* name;
+    uint32_t object_size;      // Rounded up to the cache's alignment
+    uint32_t objects_per_slab;
+    kmem_ctor_t ctor;
+    slab_t* partial;
+    slab_t* full;
+    slab_t* empty;
+    uint32_t slab_count;
+    uint32_t active_objects;
+    bool in_use;
+} kmem_cache_t;
+
+// Function prototypes
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align, kmem_ctor_t ctor);
+void kmem_cache_destroy(kmem_cache_t* cache);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* object);
+uint32_t kmem_cache_shrink(kmem_cache_t* cache);
+void kmem_cache_print_stats(void);
+
+#endif // SLAB_H
@@ -0,0 +1,17 @@
+#ifndef STRING_H
+#define STRING_H
+
+#include "types.h"
+
+// Copies at least this large bypass the cache with non-temporal stores
+#define MEM_NONTEMPORAL_THRESHOLD  (256 * 1024)
+
+// Function prototypes
+void string_init(void);
+const char* string_get_impl_name(void);
+void* memcpy(void* dest, const void* src, uint32_t n);
+void* memset(void* ptr, int value, uint32_t n);
+int memcmp(const void* ptr1, const void* ptr2, uint32_t n);
+void string_run_benchmark(const char* which);
+
+#endif // STRING_H
@@ -11,11 +11,15 @@
 
 // Timer configuration
 #define TIMER_MODE_RATE_GENERATOR    0x34
+#define TIMER_MODE_CH2_ONESHOT       0xB0  // Channel 2, lobyte/hibyte, mode 0
+#define TIMER_GATE_PORT              0x61  // Bit 0 gates channel 2, bit 5 reads its output
+#define TIMER_CALIBRATE_MS           10
 
 // Function prototypes
 void timer_init(uint32_t frequency);
 void timer_handler(void);
 uint32_t timer_get_ticks(void);
+uint32_t timer_tsc_per_ms(void);
 void timer_wait(uint32_t ticks);
 void timer_sleep(uint32_t milliseconds);
 
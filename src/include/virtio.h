@@ -0,0 +1,96 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include "types.h"
+#include "pci.h"
+
+// Virtio over the legacy PCI interface: device registers in I/O BAR0 and
+// queues handed over as a page frame number. QEMU's virtio devices are
+// transitional and offer it alongside the modern interface.
+#define VIRTIO_PCI_VENDOR          0x1AF4
+
+// Legacy register offsets from BAR0
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES  0x04
+#define VIRTIO_REG_QUEUE_PFN       0x08
+#define VIRTIO_REG_QUEUE_SIZE      0x0C
+#define VIRTIO_REG_QUEUE_SELECT    0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY    0x10
+#define VIRTIO_REG_DEVICE_STATUS   0x12
+#define VIRTIO_REG_ISR_STATUS      0x13
+#define VIRTIO_REG_CONFIG          0x14     // Device-specific configuration, without MSI-X
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE  0x01
+#define VIRTIO_STATUS_DRIVER       0x02
+#define VIRTIO_STATUS_DRIVER_OK    0x04
+#define VIRTIO_STATUS_FAILED       0x80
+
+#define VIRTIO_ISR_QUEUE           0x01     // A used ring has new entries
+
+// Split virtqueue layout (legacy): descriptor table, then the available
+// ring, then the used ring on the next page boundary
+#define VIRTQ_ALIGN                4096
+#define VIRTQ_DESC_F_NEXT          0x01
+#define VIRTQ_DESC_F_WRITE         0x02     // The device writes this buffer
+#define VIRTQ_USED_F_NO_NOTIFY     0x01     // The device asks not to be notified
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 0x01
+#define VIRTQ_NO_DESC              0xFFFF
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed)) virtq_avail_t;
+
+typedef struct {
+    uint32_t id;                            // Head descriptor of the finished chain
+    uint32_t len;                           // Bytes the device wrote
+} __attribute__((packed)) virtq_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+} __attribute__((packed)) virtq_used_t;
+
+typedef struct {
+    uint16_t index;                         // Queue number on the device
+    uint16_t size;                          // Entries, set by the device
+    virtq_desc_t* desc;
+    virtq_avail_t* avail;
+    volatile virtq_used_t* used;
+    uint16_t free_head;                     // Unused descriptors, chained through next
+    uint16_t free_count;
+    uint16_t last_used;                     // Used ring entries consumed so far
+    uint16_t kicked;                        // Available index at the last notification
+} virtqueue_t;
+
+typedef struct {
+    pci_device_t* pci;
+    uint16_t io;                            // BAR0
+    uint8_t irq;
+    uint32_t features;                      // Negotiated
+} virtio_device_t;
+
+// Function prototypes
+bool virtio_init_device(virtio_device_t* vdev, pci_device_t* pci, uint32_t wanted_features);
+void virtio_driver_ok(virtio_device_t* vdev);
+uint8_t virtio_read_isr(virtio_device_t* vdev);
+uint8_t virtio_config_read8(virtio_device_t* vdev, uint32_t offset);
+uint32_t virtio_config_read32(virtio_device_t* vdev, uint32_t offset);
+bool virtq_init(virtio_device_t* vdev, virtqueue_t* vq, uint16_t index);
+uint16_t virtq_alloc_chain(virtqueue_t* vq, uint16_t count);
+void virtq_free_chain(virtqueue_t* vq, uint16_t head);
+void virtq_publish(virtqueue_t* vq, uint16_t head);
+bool virtq_kick(virtio_device_t* vdev, virtqueue_t* vq);
+bool virtq_next_used(virtqueue_t* vq, uint16_t* head, uint32_t* len);
+
+#endif // VIRTIO_H
@@ -0,0 +1,52 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "types.h"
+#include "pmm.h"
+#include "virtio.h"
+#include "blockdev.h"
+
+#define VIRTIO_BLK_PCI_DEVICE     0x1001     // Transitional virtio-blk
+
+// Feature bits
+#define VIRTIO_BLK_F_FLUSH        (1 << 9)   // The device has a write cache to flush
+
+// Request types
+#define VIRTIO_BLK_T_IN           0
+#define VIRTIO_BLK_T_OUT          1
+#define VIRTIO_BLK_T_FLUSH        4
+
+#define VIRTIO_BLK_S_OK           0
+
+// Each request is a descriptor chain: this header, the data in physically
+// contiguous segments, then a status byte for the device to fill in
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_header_t;
+
+#define VIRTIO_BLK_MAX_SECTORS    128        // Per request; larger transfers are split
+#define VIRTIO_BLK_MAX_SEGMENTS   (VIRTIO_BLK_MAX_SECTORS * BLOCK_SECTOR_SIZE / FRAME_SIZE + 1)
+#define VIRTIO_BLK_TIMEOUT_MS     1000
+
+typedef struct {
+    uint32_t requests;                       // Descriptor chains sent to the device
+    uint32_t batches;                        // Calls that sent at least one
+    uint32_t notifications;                  // Doorbell writes
+    uint32_t interrupts;
+    uint32_t completions;
+    uint32_t reaps;                          // Passes over the used ring that found work
+    uint32_t max_reaped;                     // Most completions taken in one pass
+    uint32_t max_in_flight;
+    uint32_t errors;
+} virtio_blk_stats_t;
+
+// Function prototypes
+uint32_t virtio_blk_init(void);
+bool virtio_blk_available(void);
+void virtio_blk_irq_handler(void);
+void virtio_blk_print_stats(void);
+void virtio_blk_run_benchmark(void);
+
+#endif // VIRTIO_BLK_H
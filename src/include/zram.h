@@ -0,0 +1,59 @@
+#ifndef ZRAM_H
+#define ZRAM_H
+
+#include "types.h"
+#include "pmm.h"
+
+// Pageable memory backed by a compressed in-memory store. Pages in the
+// window are mapped on first touch; once more than ZRAM_RESIDENT_LIMIT are
+// resident, the clock hand picks a cold one, compresses it into the store
+// and unmaps it. Touching it again faults it back in.
+#define ZRAM_WINDOW         0xE0000000 // Virtual region for pageable allocations
+#define ZRAM_WINDOW_SIZE    0x10000000 // 256MB of address space
+#define ZRAM_WINDOW_PAGES   (ZRAM_WINDOW_SIZE / FRAME_SIZE)
+#define ZRAM_RESIDENT_LIMIT 256        // Frames the window may hold (1MB)
+#define ZRAM_MAX_COMPRESSED 3072       // Pages that don't shrink below this are stored as-is
+
+// Non-present PTEs in the window use the available bits to say where the
+// page is. A stored page keeps its slot number in the frame field.
+#define PTE_ZRAM_ZERO       0x200      // Allocated, contents all zero
+#define PTE_ZRAM_STORED     0x400      // Compressed in the store
+#define PTE_ZRAM_SLOT_SHIFT 12
+
+typedef struct {
+    uint32_t allocated_pages;        // Window pages handed out
+    uint32_t resident_pages;         // Of those, mapped to a frame
+    uint32_t stored_pages;           // Held in the store
+    uint32_t raw_pages;              // Stored uncompressed
+    uint32_t reserve_pages;          // Stored in reserve frames because the heap was full
+    uint32_t stored_bytes;           // Compressed size of the stored pages
+    uint32_t store_footprint;        // Heap bytes the store occupies
+    uint32_t evictions;
+    uint32_t zero_evictions;         // Evicted pages that were all zero
+    uint32_t faults;
+    uint32_t fault_cycles_avg;
+    uint32_t fault_cycles_max;
+    uint32_t compress_cycles_avg;
+} zram_stats_t;
+
+// Where the pages of one allocation are right now
+typedef struct {
+    uint32_t resident_pages;
+    uint32_t zero_pages;             // Untouched, or evicted while all zero
+    uint32_t stored_pages;
+    uint32_t stored_bytes;           // Heap the stored pages take
+} zram_usage_t;
+
+// Function prototypes
+void zram_init(void);
+bool zram_available(void);
+void* zram_alloc(uint32_t pages);
+void zram_free(void* addr, uint32_t pages);
+bool zram_owns(const void* addr);
+void zram_add_usage(const void* addr, uint32_t pages, zram_usage_t* usage);
+bool zram_fault(uint32_t address);
+void zram_get_stats(zram_stats_t* stats);
+void zram_print_stats(void);
+void zram_run_test(uint32_t megabytes);
+
+#endif // ZRAM_H
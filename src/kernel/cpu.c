@@ -0,0 +1,22 @@
+#include "cpu.h"
+
+// CPUID leaf 1 feature words, captured once at boot
+static uint32_t features_edx = 0;
+static bool sse_enabled = false;
+
+void cpu_init(void) {
+    uint32_t eax, ebx, ecx;
+    cpuid(1, &eax, &ebx, &ecx, &features_edx);
+    
+    // SSE needs FXSAVE support and OS opt-in through CR0/CR4
+    uint32_t sse = CPUID_FEAT_EDX_FXSR | CPUID_FEAT_EDX_SSE | CPUID_FEAT_EDX_SSE2;
+    if ((features_edx & sse) == sse) {
+        write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+        write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+        sse_enabled = true;
+    }
+}
+
+bool cpu_has_sse2(void) {
+    return sse_enabled;
+}
@@ -10,6 +10,9 @@ static struct idt_ptr idt_ptr;
 // Assembly interrupt handlers
 extern void irq0_handler(void);  // Timer
 extern void irq1_handler(void);  // Keyboard
+extern void isr14_handler(void); // Page fault
+extern void irq14_handler(void); // Primary IDE channel
+extern void irq15_handler(void); // Secondary IDE channel
 
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags) {
     idt_entries[num].base_low = base & 0xFFFF;
@@ -28,12 +31,20 @@ void idt_init(void) {
         idt_set_gate(i, 0, 0, 0);
     }
     
+    // Set page fault exception (interrupt 14)
+    idt_set_gate(14, (uint32_t)isr14_handler, 0x08, 0x8E);
+    
     // Set timer interrupt (IRQ0 = interrupt 32)
     idt_set_gate(32, (uint32_t)irq0_handler, 0x08, 0x8E);
     
     // Set keyboard interrupt (IRQ1 = interrupt 33)
     idt_set_gate(33, (uint32_t)irq1_handler, 0x08, 0x8E);
     
+    // Set IDE channel interrupts (IRQ14/15 = interrupts 46/47); the ATA
+    // driver unmasks them once it finds a bus-master controller
+    idt_set_gate(46, (uint32_t)irq14_handler, 0x08, 0x8E);
+    idt_set_gate(47, (uint32_t)irq15_handler, 0x08, 0x8E);
+    
     // Load IDT
     asm volatile("lidt %0" : : "m" (idt_ptr));
     
@@ -5,8 +5,18 @@
 #include "../include/shell.h"
 #include "../include/timer.h"
 #include "../include/memory.h"
+#include "../include/pmm.h"
+#include "../include/paging.h"
+#include "../include/zram.h"
 #include "../include/filesystem.h"
+#include "../include/initrd.h"
+#include "../include/pci.h"
+#include "../include/virtio_blk.h"
+#include "../include/ata.h"
+#include "../include/bcache.h"
 #include "../include/io.h"
+#include "../include/cpu.h"
+#include "../include/string.h"
 #include "../include/types.h"
 
 // Set to 0 for interrupt mode, 1 for safe polling mode
@@ -36,7 +46,7 @@ static void display_boot_logo(void) {
     screen_println("");
 }
 
-void kernel_main(void) {
+void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
     // Initialize screen driver
     screen_init();
     screen_clear();
@@ -50,6 +60,12 @@ void kernel_main(void) {
     screen_print("[ OK ] "); screen_println("Screen Functions");
     screen_print("[ OK ] "); screen_println("Color Support");
     
+    // Probe CPU features, enable SSE and pick the memory routines
+    cpu_init();
+    string_init();
+    screen_print("[ OK ] "); screen_print("CPU Features (");
+    screen_print(string_get_impl_name()); screen_println(" memory ops)");
+    
     // Initialize IDT
     idt_init();
     screen_print("[ OK ] "); screen_println("Interrupt Descriptor Table");
@@ -58,13 +74,56 @@ void kernel_main(void) {
     timer_init(100);
     screen_print("[ OK ] "); screen_println("Timer Driver (100Hz)");
     
+    // Initialize physical memory from the bootloader's memory map
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        kernel_panic("Not booted by a multiboot loader");
+    }
+    pmm_init(mbi);
+    screen_print("[ OK ] "); screen_println("Physical Memory Manager");
+    
+    // Enable paging with all RAM identity mapped
+    paging_init();
+    screen_print("[ OK ] ");
+    screen_println(paging_large_pages_enabled() ? "Paging (4MB PSE Pages)" : "Paging (4KB Pages)");
+    
     // Initialize memory management
     memory_init();
-    screen_print("[ OK ] "); screen_println("Memory Management (4MB Heap)");
+    screen_print("[ OK ] "); screen_println("Memory Management (On-Demand Heap)");
+    
+    // Pageable memory backed by the compressed store
+    zram_init();
+    if (zram_available()) {
+        screen_print("[ OK ] "); screen_println("Compressed Memory (zram, LZ4)");
+    }
+    
+    // Enumerate PCI functions; the disk drivers look for their controllers here
+    pci_init();
+    screen_print("[ OK ] "); screen_println("PCI Bus");
+    
+    // Probe disks, virtio first so that it backs the filesystem when
+    // present, and set up the buffer cache in front of them
+    if (virtio_blk_init() > 0) {
+        screen_print("[ OK ] "); screen_println("virtio-blk Disk (Split Virtqueue)");
+    }
+    uint32_t disks = ata_init();
+    if (disks > 0) {
+        screen_print("[ OK ] "); screen_print("ATA Disk (");
+        screen_print(ata_get_model(0));
+        screen_println(ata_dma_available() ? ", Bus-Master DMA)" : ", PIO)");
+    }
+    if (bcache_init()) {
+        screen_print("[ OK ] "); screen_println("Buffer Cache (LRU, Write-Back)");
+    }
+    
+    // The initrd module is used where the loader put it; only its header is read
+    if (initrd_init(mbi)) {
+        screen_print("[ OK ] "); screen_println("Initrd (Read-Only, In Place)");
+    }
     
     // Initialize file system
     fs_init();
-    screen_print("[ OK ] "); screen_println("File System (In-Memory)");
+    screen_print("[ OK ] ");
+    screen_println(fs_is_persistent() ? "File System (On Disk)" : "File System (In-Memory)");
     
     // Initialize keyboard
     keyboard_init();
@@ -122,6 +181,12 @@ void safe_mode_test(void) {
     shell_run();
 }
 
+// Called while waiting for input. Runs one small piece of background work
+// and returns false if there was none, so the caller can back off.
+bool kernel_idle(void) {
+    return memory_idle() || fs_idle();
+}
+
 void kernel_panic(const char* message) {
     screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_RED);
     screen_println("");
@@ -0,0 +1,134 @@
+#include "initrd.h"
+#include "string.h"
+
+// The module as the loader left it, or NULL
+static const uint8_t* image = NULL;
+static const initrd_header_t* header = NULL;
+static const uint32_t* buckets = NULL;
+static const initrd_entry_t* entries = NULL;
+
+// FNV-1a, as mkinitrd computes it
+static uint32_t initrd_hash(const char* path, uint32_t length) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)path[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// True if count items of size bytes at offset lie inside the image
+static bool initrd_in_bounds(uint32_t offset, uint32_t count, uint32_t size) {
+    if (offset > header->image_size) {
+        return false;
+    }
+    return count <= (header->image_size - offset) / size;
+}
+
+// Entries are checked when a lookup reaches them rather than at mount,
+// which keeps mounting independent of the number of files
+static bool initrd_entry_valid(const initrd_entry_t* entry) {
+    return initrd_in_bounds(entry->path_offset, entry->path_length, 1) &&
+           initrd_in_bounds(entry->data_offset, entry->size, 1) &&
+           entry->name_start < entry->path_length &&
+           (entry->parent == INITRD_NONE || entry->parent < header->entry_count);
+}
+
+// Take the first module if it holds an initrd image. Only the header is
+// read; nothing is copied.
+bool initrd_init(multiboot_info_t* mbi) {
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS) || mbi->mods_count == 0) {
+        return false;
+    }
+    multiboot_module_t* module = (multiboot_module_t*)mbi->mods_addr;
+    uint32_t size = module->mod_end - module->mod_start;
+    const initrd_header_t* candidate = (const initrd_header_t*)module->mod_start;
+    if (module->mod_end < module->mod_start || size < sizeof(initrd_header_t) ||
+        memcmp(candidate->magic, INITRD_MAGIC, 8) != 0 || candidate->version != INITRD_VERSION ||
+        candidate->image_size > size) {
+        return false;
+    }
+    
+    header = candidate;
+    if (header->bucket_count == 0 || (header->bucket_count & (header->bucket_count - 1)) ||
+        !initrd_in_bounds(header->buckets_offset, header->bucket_count, sizeof(uint32_t)) ||
+        !initrd_in_bounds(header->entries_offset, header->entry_count, sizeof(initrd_entry_t))) {
+        header = NULL;
+        return false;
+    }
+    
+    image = (const uint8_t*)module->mod_start;
+    buckets = (const uint32_t*)(image + header->buckets_offset);
+    entries = (const initrd_entry_t*)(image + header->entries_offset);
+    return true;
+}
+
+bool initrd_available(void) {
+    return image != NULL;
+}
+
+uint32_t initrd_entry_count(void) {
+    return image ? header->entry_count : 0;
+}
+
+uint32_t initrd_image_size(void) {
+    return image ? header->image_size : 0;
+}
+
+// Entry for the first length bytes of path, ignoring leading and trailing
+// separators, or NULL
+const initrd_entry_t* initrd_lookup(const char* path, uint32_t length) {
+    if (!image) {
+        return NULL;
+    }
+    while (length > 0 && *path == '/') {
+        path++;
+        length--;
+    }
+    while (length > 0 && path[length - 1] == '/') {
+        length--;
+    }
+    if (length == 0) {
+        return NULL;
+    }
+    
+    // A damaged image could link a chain into a loop; no chain is longer
+    // than the number of entries
+    uint32_t hash = initrd_hash(path, length);
+    uint32_t index = buckets[hash & (header->bucket_count - 1)];
+    for (uint32_t steps = 0; index < header->entry_count && steps < header->entry_count; steps++) {
+        const initrd_entry_t* entry = &entries[index];
+        if (!initrd_entry_valid(entry)) {
+            return NULL;
+        }
+        if (entry->hash == hash && entry->path_length == length &&
+            memcmp(image + entry->path_offset, path, length) == 0) {
+            return entry;
+        }
+        index = entry->next;
+    }
+    return NULL;
+}
+
+// Entry by position, for walking the whole image; NULL if out of range or damaged
+const initrd_entry_t* initrd_get_entry(uint32_t index) {
+    if (!image || index >= header->entry_count || !initrd_entry_valid(&entries[index])) {
+        return NULL;
+    }
+    return &entries[index];
+}
+
+uint32_t initrd_index(const initrd_entry_t* entry) {
+    return entry - entries;
+}
+
+// File contents, straight from the module
+const uint8_t* initrd_data(const initrd_entry_t* entry) {
+    return image + entry->data_offset;
+}
+
+// Last path component; not terminated, so the length is returned too
+const char* initrd_name(const initrd_entry_t* entry, uint32_t* length) {
+    *length = entry->path_length - entry->name_start;
+    return (const char*)image + entry->path_offset + entry->name_start;
+}
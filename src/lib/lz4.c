@@ -0,0 +1,213 @@
+#include "lz4.h"
+#include "string.h"
+
+// Unaligned 32-bit loads; x86 handles them natively
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32;
+
+// Last position seen for each hash of four input bytes, relative to the
+// start of the block being compressed
+static uint16_t hash_table[1 << LZ4_HASH_BITS];
+
+static inline uint32_t read32(const uint8_t* p) {
+    return *(const unaligned_u32*)p;
+}
+
+static inline void write32(uint8_t* p, uint32_t value) {
+    *(unaligned_u32*)p = value;
+}
+
+// Copy forwards four bytes at a time. Safe for overlapping matches as long
+// as the source starts at least four bytes before the destination.
+static inline void copy_forward(uint8_t* dst, const uint8_t* src, uint32_t length) {
+    while (length >= 4) {
+        write32(dst, read32(src));
+        dst += 4;
+        src += 4;
+        length -= 4;
+    }
+    while (length--) {
+        *dst++ = *src++;
+    }
+}
+
+static inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Lengths of 15 or more spill into extra bytes of 255 each
+static uint8_t* write_length(uint8_t* op, uint32_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Write one sequence: literals followed by a match, or just the final
+// literals when match_length is 0. Returns NULL if the output is full.
+static uint8_t* write_sequence(uint8_t* op, uint8_t* op_end, const uint8_t* literals,
+                               uint32_t literal_length, uint32_t offset, uint32_t match_length) {
+    uint32_t worst = 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+    if (worst > (uint32_t)(op_end - op)) {
+        return NULL;
+    }
+    
+    uint8_t* token = op++;
+    if (literal_length >= 15) {
+        *token = 0xF0;
+        op = write_length(op, literal_length - 15);
+    } else {
+        *token = (uint8_t)(literal_length << 4);
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+    
+    if (match_length == 0) {
+        return op;
+    }
+    
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    uint32_t extra = match_length - LZ4_MIN_MATCH;
+    if (extra >= 15) {
+        *token |= 15;
+        op = write_length(op, extra - 15);
+    } else {
+        *token |= (uint8_t)extra;
+    }
+    return op;
+}
+
+// Greedy single-pass compressor. Returns the compressed size, or 0 if the
+// input is too long or the result does not fit in capacity bytes.
+uint32_t lz4_compress(const uint8_t* src, uint32_t length, uint8_t* dst, uint32_t capacity) {
+    if (length > LZ4_MAX_INPUT) {
+        return 0;
+    }
+    
+    for (uint32_t i = 0; i < (1u << LZ4_HASH_BITS); i++) {
+        hash_table[i] = 0;
+    }
+    
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + length;
+    const uint8_t* match_limit = length > LZ4_MF_LIMIT ? end - LZ4_MF_LIMIT : src;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + capacity;
+    uint32_t misses = 0;
+    
+    while (ip < match_limit) {
+        uint32_t sequence = read32(ip);
+        uint32_t hash = hash4(sequence);
+        const uint8_t* ref = src + hash_table[hash];
+        hash_table[hash] = (uint16_t)(ip - src);
+        
+        // Step faster through data that keeps missing, as LZ4 does; it
+        // is likely incompressible
+        if (ref >= ip || read32(ref) != sequence) {
+            ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+            continue;
+        }
+        misses = 0;
+        
+        // Extend the match backwards into the pending literals, then forwards
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+        const uint8_t* match_end = ip + LZ4_MIN_MATCH;
+        const uint8_t* ref_end = ref + LZ4_MIN_MATCH;
+        while (match_end < end - LZ4_LAST_LITERALS && *match_end == *ref_end) {
+            match_end++;
+            ref_end++;
+        }
+        
+        op = write_sequence(op, op_end, anchor, ip - anchor, ip - ref, match_end - ip);
+        if (!op) {
+            return 0;
+        }
+        ip = match_end;
+        anchor = ip;
+    }
+    
+    op = write_sequence(op, op_end, anchor, end - anchor, 0, 0);
+    return op ? (uint32_t)(op - dst) : 0;
+}
+
+// Lengths of 15 continue in the following bytes. Returns false on overrun.
+static bool read_length(const uint8_t** ip, const uint8_t* ip_end, uint32_t* length) {
+    uint8_t byte;
+    do {
+        if (*ip >= ip_end) {
+            return false;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Returns the decompressed size, or -1 if the input is malformed or would
+// write past capacity bytes
+int32_t lz4_decompress(const uint8_t* src, uint32_t length, uint8_t* dst, uint32_t capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + length;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + capacity;
+    
+    while (ip < ip_end) {
+        uint32_t token = *ip++;
+        
+        uint32_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(&ip, ip_end, &literal_length)) {
+            return -1;
+        }
+        if (literal_length > (uint32_t)(ip_end - ip) || literal_length > (uint32_t)(op_end - op)) {
+            return -1;
+        }
+        if (literal_length >= 64) {
+            memcpy(op, ip, literal_length);
+        } else {
+            copy_forward(op, ip, literal_length);
+        }
+        ip += literal_length;
+        op += literal_length;
+        
+        if (ip == ip_end) {
+            break; // The last sequence has no match
+        }
+        
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) {
+            return -1;
+        }
+        
+        uint32_t match_length = token & 15;
+        if (match_length == 15 && !read_length(&ip, ip_end, &match_length)) {
+            return -1;
+        }
+        match_length += LZ4_MIN_MATCH;
+        if (match_length > (uint32_t)(op_end - op)) {
+            return -1;
+        }
+        
+        // Overlapping matches repeat the last 'offset' bytes, so copy forwards
+        const uint8_t* ref = op - offset;
+        if (offset >= 4) {
+            copy_forward(op, ref, match_length);
+            op += match_length;
+        } else {
+            while (match_length--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    
+    return (int32_t)(op - dst);
+}
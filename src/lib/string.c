@@ -0,0 +1,364 @@
+#include "string.h"
+#include "cpu.h"
+#include "memory.h"
+#include "screen.h"
+
+// Interrupt handlers do not save XMM registers, so they must not call
+// these routines while the SSE2 implementation is active.
+
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32;
+
+static void print_number(uint32_t num);
+static void print_column(uint32_t num, const char* suffix, uint32_t width);
+
+// Byte-at-a-time reference implementation
+static void* memcpy_byte(void* dest, const void* src, uint32_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    
+    for (uint32_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+    
+    return dest;
+}
+
+static void* memset_byte(void* ptr, int value, uint32_t n) {
+    uint8_t* p = (uint8_t*)ptr;
+    
+    for (uint32_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)value;
+    }
+    
+    return ptr;
+}
+
+static int memcmp_byte(const void* ptr1, const void* ptr2, uint32_t n) {
+    const uint8_t* p1 = (const uint8_t*)ptr1;
+    const uint8_t* p2 = (const uint8_t*)ptr2;
+    
+    for (uint32_t i = 0; i < n; i++) {
+        if (p1[i] < p2[i]) return -1;
+        if (p1[i] > p2[i]) return 1;
+    }
+    
+    return 0;
+}
+
+// String instructions: dword moves with a byte tail
+static void* memcpy_rep(void* dest, const void* src, uint32_t n) {
+    uint32_t ecx, edi, esi;
+    asm volatile ("rep movsl\n\t"
+                  "mov %4, %%ecx\n\t"
+                  "rep movsb"
+                  : "=&c"(ecx), "=&D"(edi), "=&S"(esi)
+                  : "0"(n / 4), "r"(n & 3), "1"(dest), "2"(src)
+                  : "memory");
+    return dest;
+}
+
+static void* memset_rep(void* ptr, int value, uint32_t n) {
+    uint32_t pattern = (uint8_t)value * 0x01010101u;
+    uint32_t ecx, edi;
+    asm volatile ("rep stosl\n\t"
+                  "mov %4, %%ecx\n\t"
+                  "rep stosb"
+                  : "=&c"(ecx), "=&D"(edi)
+                  : "0"(n / 4), "a"(pattern), "r"(n & 3), "1"(ptr)
+                  : "memory");
+    return ptr;
+}
+
+static int memcmp_rep(const void* ptr1, const void* ptr2, uint32_t n) {
+    const uint8_t* p1 = (const uint8_t*)ptr1;
+    const uint8_t* p2 = (const uint8_t*)ptr2;
+    
+    // Skip equal dwords, then let the byte loop find the difference
+    while (n >= 4 && *(const unaligned_u32*)p1 == *(const unaligned_u32*)p2) {
+        p1 += 4;
+        p2 += 4;
+        n -= 4;
+    }
+    return memcmp_byte(p1, p2, n);
+}
+
+static inline void copy_bytes(uint8_t* d, const uint8_t* s, uint32_t n) {
+    asm volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+// SSE2: align the destination, then move 64 bytes per iteration
+__attribute__((target("sse2")))
+static void* memcpy_sse2(void* dest, const void* src, uint32_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    
+    uint32_t head = (0u - (uint32_t)d) & 15;
+    if (head > n) {
+        head = n;
+    }
+    copy_bytes(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    
+    uint32_t blocks = n / 64;
+    if (blocks && n >= MEM_NONTEMPORAL_THRESHOLD) {
+        // Streaming stores keep a huge copy from flushing the whole cache
+        asm volatile ("1:\n\t"
+                      "movdqu 0(%1), %%xmm0\n\t"
+                      "movdqu 16(%1), %%xmm1\n\t"
+                      "movdqu 32(%1), %%xmm2\n\t"
+                      "movdqu 48(%1), %%xmm3\n\t"
+                      "movntdq %%xmm0, 0(%0)\n\t"
+                      "movntdq %%xmm1, 16(%0)\n\t"
+                      "movntdq %%xmm2, 32(%0)\n\t"
+                      "movntdq %%xmm3, 48(%0)\n\t"
+                      "add $64, %1\n\t"
+                      "add $64, %0\n\t"
+                      "dec %2\n\t"
+                      "jnz 1b\n\t"
+                      "sfence"
+                      : "+r"(d), "+r"(s), "+r"(blocks)
+                      :
+                      : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    } else if (blocks) {
+        asm volatile ("1:\n\t"
+                      "movdqu 0(%1), %%xmm0\n\t"
+                      "movdqu 16(%1), %%xmm1\n\t"
+                      "movdqu 32(%1), %%xmm2\n\t"
+                      "movdqu 48(%1), %%xmm3\n\t"
+                      "movdqa %%xmm0, 0(%0)\n\t"
+                      "movdqa %%xmm1, 16(%0)\n\t"
+                      "movdqa %%xmm2, 32(%0)\n\t"
+                      "movdqa %%xmm3, 48(%0)\n\t"
+                      "add $64, %1\n\t"
+                      "add $64, %0\n\t"
+                      "dec %2\n\t"
+                      "jnz 1b"
+                      : "+r"(d), "+r"(s), "+r"(blocks)
+                      :
+                      : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    }
+    
+    copy_bytes(d, s, n & 63);
+    return dest;
+}
+
+__attribute__((target("sse2")))
+static void* memset_sse2(void* ptr, int value, uint32_t n) {
+    uint8_t* p = (uint8_t*)ptr;
+    
+    uint32_t head = (0u - (uint32_t)p) & 15;
+    if (head > n) {
+        head = n;
+    }
+    memset_rep(p, value, head);
+    p += head;
+    n -= head;
+    
+    uint32_t blocks = n / 64;
+    if (blocks) {
+        uint32_t pattern = (uint8_t)value * 0x01010101u;
+        asm volatile ("movd %2, %%xmm0\n\t"
+                      "pshufd $0, %%xmm0, %%xmm0\n\t"
+                      "1:\n\t"
+                      "movdqa %%xmm0, 0(%0)\n\t"
+                      "movdqa %%xmm0, 16(%0)\n\t"
+                      "movdqa %%xmm0, 32(%0)\n\t"
+                      "movdqa %%xmm0, 48(%0)\n\t"
+                      "add $64, %0\n\t"
+                      "dec %1\n\t"
+                      "jnz 1b"
+                      : "+r"(p), "+r"(blocks)
+                      : "r"(pattern)
+                      : "xmm0", "memory");
+    }
+    
+    memset_rep(p, value, n & 63);
+    return ptr;
+}
+
+__attribute__((target("sse2")))
+static int memcmp_sse2(const void* ptr1, const void* ptr2, uint32_t n) {
+    const uint8_t* p1 = (const uint8_t*)ptr1;
+    const uint8_t* p2 = (const uint8_t*)ptr2;
+    
+    // Compare 16 bytes at a time; the mask has a bit per equal byte
+    while (n >= 16) {
+        uint32_t mask;
+        asm volatile ("movdqu (%1), %%xmm0\n\t"
+                      "movdqu (%2), %%xmm1\n\t"
+                      "pcmpeqb %%xmm1, %%xmm0\n\t"
+                      "pmovmskb %%xmm0, %0"
+                      : "=r"(mask)
+                      : "r"(p1), "r"(p2)
+                      : "xmm0", "xmm1", "memory");
+        if (mask != 0xFFFF) {
+            uint32_t i = __builtin_ctz(~mask);
+            return p1[i] < p2[i] ? -1 : 1;
+        }
+        p1 += 16;
+        p2 += 16;
+        n -= 16;
+    }
+    
+    return memcmp_byte(p1, p2, n);
+}
+
+// Implementation table; the active entry is chosen once at boot
+typedef struct {
+    const char* name;
+    void* (*copy)(void* dest, const void* src, uint32_t n);
+    void* (*set)(void* ptr, int value, uint32_t n);
+    int (*cmp)(const void* ptr1, const void* ptr2, uint32_t n);
+} mem_impl_t;
+
+#define MEM_IMPL_BYTE   0
+#define MEM_IMPL_REP    1
+#define MEM_IMPL_SSE2   2
+#define MEM_IMPL_COUNT  3
+
+static const mem_impl_t mem_impls[MEM_IMPL_COUNT] = {
+    { "byte", memcpy_byte, memset_byte, memcmp_byte },
+    { "rep",  memcpy_rep,  memset_rep,  memcmp_rep  },
+    { "sse2", memcpy_sse2, memset_sse2, memcmp_sse2 },
+};
+
+// Safe to call before string_init
+static const mem_impl_t* active_impl = &mem_impls[MEM_IMPL_BYTE];
+
+void string_init(void) {
+    active_impl = cpu_has_sse2() ? &mem_impls[MEM_IMPL_SSE2] : &mem_impls[MEM_IMPL_REP];
+}
+
+const char* string_get_impl_name(void) {
+    return active_impl->name;
+}
+
+void* memcpy(void* dest, const void* src, uint32_t n) {
+    return active_impl->copy(dest, src, n);
+}
+
+void* memset(void* ptr, int value, uint32_t n) {
+    return active_impl->set(ptr, value, n);
+}
+
+int memcmp(const void* ptr1, const void* ptr2, uint32_t n) {
+    return active_impl->cmp(ptr1, ptr2, n);
+}
+
+// Microbenchmark: cycles per call for each implementation, 16B to 1MB
+#define BENCH_MAX_SIZE      (1024 * 1024)
+#define BENCH_BYTES         (4 * 1024 * 1024)  // Work per measurement
+
+static volatile int bench_sink;
+
+static uint32_t bench_one(const mem_impl_t* impl, char op, uint8_t* a, uint8_t* b, uint32_t size) {
+    uint32_t iterations = BENCH_BYTES / size;
+    if (iterations < 4) {
+        iterations = 4;
+    }
+    
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (op == 'c') {
+            impl->copy(a, b, size);
+        } else if (op == 's') {
+            impl->set(a, i, size);
+        } else {
+            bench_sink += impl->cmp(a, b, size);
+        }
+    }
+    uint64_t cycles = rdtsc() - start;
+    
+    return (uint32_t)cycles / iterations;
+}
+
+void string_run_benchmark(const char* which) {
+    char op = 'c';
+    const char* title = "memcpy";
+    if (which && which[0] == 's') {
+        op = 's';
+        title = "memset";
+    } else if (which && which[0] == 'c' && which[1] == 'm') {
+        op = 'm';
+        title = "memcmp";
+    }
+    
+    // Offset the source by 4 so the SSE2 path sees misaligned loads
+    uint8_t* a = (uint8_t*)kmalloc(BENCH_MAX_SIZE + 16);
+    uint8_t* b = (uint8_t*)kmalloc(BENCH_MAX_SIZE + 16);
+    if (!a || !b) {
+        screen_println("Not enough memory for the benchmark.");
+        kfree(a);
+        kfree(b);
+        return;
+    }
+    memset(a, 0x5A, BENCH_MAX_SIZE + 16);
+    memset(b, 0x5A, BENCH_MAX_SIZE + 16);
+    
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_print(title);
+    screen_print(" cycles per call (active: ");
+    screen_print(active_impl->name);
+    screen_println(")");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    screen_println("  SIZE        BYTE        REP         SSE2");
+    
+    for (uint32_t size = 16; size <= BENCH_MAX_SIZE; size *= 4) {
+        screen_print("  ");
+        if (size >= 1024) {
+            print_column(size / 1024, "K", 12);
+        } else {
+            print_column(size, "B", 12);
+        }
+        
+        for (int impl = 0; impl < MEM_IMPL_COUNT; impl++) {
+            if (impl == MEM_IMPL_SSE2 && !cpu_has_sse2()) {
+                screen_print("n/a");
+                continue;
+            }
+            print_column(bench_one(&mem_impls[impl], op, a, b + 4, size), "", 12);
+        }
+        screen_println("");
+    }
+    
+    kfree(a);
+    kfree(b);
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
+
+// Print a number and suffix left-aligned in a column of the given width
+static void print_column(uint32_t num, const char* suffix, uint32_t width) {
+    uint32_t length = 1;
+    for (uint32_t v = num; v >= 10; v /= 10) length++;
+    for (const char* c = suffix; *c; c++) length++;
+    
+    print_number(num);
+    screen_print(suffix);
+    for (; length < width; length++) {
+        screen_print(" ");
+    }
+}
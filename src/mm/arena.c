@@ -0,0 +1,99 @@
+#include "../include/arena.h"
+#include "../include/memory.h"
+
+// Add a chunk that can hold at least size bytes after the current one
+static arena_chunk_t* arena_add_chunk(arena_t* arena, uint32_t size) {
+    uint32_t bytes = size > arena->chunk_size ? size : arena->chunk_size;
+    arena_chunk_t* chunk = kmalloc(sizeof(arena_chunk_t) + bytes);
+    if (!chunk) {
+        return NULL;
+    }
+    
+    chunk->next = NULL;
+    chunk->size = bytes;
+    chunk->used = 0;
+    
+    if (arena->current) {
+        arena->current->next = chunk;
+    } else {
+        arena->head = chunk;
+    }
+    arena->current = chunk;
+    return chunk;
+}
+
+void arena_init(arena_t* arena, uint32_t chunk_size) {
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+    arena->peak = 0;
+}
+
+void* arena_alloc(arena_t* arena, uint32_t size) {
+    if (size > 0x80000000) {
+        return NULL;
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    
+    arena_chunk_t* chunk = arena->current;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = arena_add_chunk(arena, size);
+        if (!chunk) {
+            return NULL;
+        }
+    }
+    
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char* arena_strndup(arena_t* arena, const char* str, uint32_t length) {
+    char* copy = arena_alloc(arena, length + 1);
+    if (copy) {
+        memcpy(copy, str, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+uint32_t arena_used(const arena_t* arena) {
+    uint32_t used = 0;
+    for (arena_chunk_t* chunk = arena->head; chunk; chunk = chunk->next) {
+        used += chunk->used;
+    }
+    return used;
+}
+
+void arena_reset(arena_t* arena) {
+    uint32_t used = arena_used(arena);
+    if (used > arena->peak) {
+        arena->peak = used;
+    }
+    
+    if (!arena->head) {
+        return;
+    }
+    
+    // Keep the first chunk; overflow chunks go back to the heap
+    arena_chunk_t* chunk = arena->head->next;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        kfree(chunk);
+        chunk = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    arena->current = arena->head;
+}
+
+void arena_destroy(arena_t* arena) {
+    arena_chunk_t* chunk = arena->head;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        kfree(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+}
@@ -1,68 +1,844 @@
 #include "../include/memory.h"
+#include "../include/pmm.h"
 #include "../include/screen.h"
 
 // Forward declaration of print_number function
 static void print_number(uint32_t num);
+static void print_column(uint32_t num, const char* suffix, uint32_t width);
 
 // Global memory management state
-static memory_block_t* heap_start = NULL;
 static bool memory_initialized = false;
 static uint32_t total_allocated = 0;
+static uint32_t heap_size = 0;                  // Bytes obtained from the frame allocator
+static memory_block_t* heap_epilogue = NULL;    // End tag of the newest region
+
+// Free lists per size class, plus a bitmap of the non-empty ones
+static memory_block_t* free_bins[HEAP_NUM_BINS];
+static uint32_t bin_map[HEAP_NUM_BINS / 32];
+
+// Free block at the end of the heap; carved only when no bin can serve a request
+static memory_block_t* heap_top = NULL;
+
+// Part of the top block's payload known to be zero, cleared by memory_idle.
+// Only valid for the current top; any other change of top empties it.
+static uint8_t* zero_lo = NULL;
+static uint8_t* zero_hi = NULL;
+
+// Always-on counters; the free-block fields are filled in by memory_get_stats
+static heap_stats_t stats;
+
+// Per-subsystem accounting and the tag new allocations are charged to
+static mem_tag_stats_t tag_stats[MEM_TAG_COUNT];
+static mem_tag_t current_tag = MEM_TAG_KERNEL;
+static const char* tag_names[MEM_TAG_COUNT] = { "kernel", "shell", "fs", "drivers", "zram" };
+
+// Registered shrinkers, sorted by priority
+static shrinker_t shrinkers[SHRINKER_MAX];
+static uint32_t shrinker_count = 0;
+static bool in_reclaim = false;
+
+// Cap on heap plus page-direct bytes while the shrink test runs, 0 for none
+static uint32_t memory_budget = 0;
+
+// Page-direct allocations by address. The table is an open-addressed hash
+// with linear probing that lives in frames of its own, so growing it never
+// goes through kmalloc. Address 0 marks an empty slot.
+#define LARGE_TABLE_MIN_BITS 9         // 512 entries, one frame
+
+typedef struct {
+    uint32_t addr;
+    uint32_t frames : 24;
+    uint32_t tag : 8;
+} large_entry_t;
+
+static large_entry_t* large_table = NULL;
+static uint32_t large_bits = 0;
+static uint32_t large_count = 0;
+static uint32_t large_bytes = 0;
+
+// Boundary tag helpers
+static memory_footer_t* block_footer(memory_block_t* block) {
+    return (memory_footer_t*)((uint8_t*)block + HEAP_HEADER_SIZE + block->size);
+}
+
+static memory_block_t* block_next(memory_block_t* block) {
+    return (memory_block_t*)((uint8_t*)block + HEAP_OVERHEAD + block->size);
+}
+
+// Footer of the physically preceding block
+static memory_footer_t* block_prev_footer(memory_block_t* block) {
+    return (memory_footer_t*)((uint8_t*)block - HEAP_FOOTER_SIZE);
+}
+
+static memory_block_t* block_prev(memory_block_t* block) {
+    memory_footer_t* footer = block_prev_footer(block);
+    return (memory_block_t*)((uint8_t*)footer - footer->size - HEAP_HEADER_SIZE);
+}
+
+static void block_set(memory_block_t* block, uint32_t size, bool is_free) {
+    block->size = size;
+    block->is_free = is_free;
+    memory_footer_t* footer = block_footer(block);
+    footer->size = size;
+    footer->is_free = is_free;
+}
+
+static memory_block_t* block_from_ptr(void* ptr) {
+    return (memory_block_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+}
+
+// Map a block size to its bin index
+static uint32_t size_to_bin(uint32_t size) {
+    if (size < HEAP_SMALL_LIMIT) {
+        return size / HEAP_BIN_STEP;
+    }
+    
+    // 512-1023 -> first large bin, 1024-2047 -> second, ...
+    uint32_t bin = HEAP_SMALL_BINS + (31 - __builtin_clz(size)) - 9;
+    return bin < HEAP_NUM_BINS ? bin : HEAP_NUM_BINS - 1;
+}
+
+static void bin_insert(memory_block_t* block) {
+    uint32_t bin = size_to_bin(block->size);
+    memory_block_t* prev = NULL;
+    memory_block_t* next = free_bins[bin];
+    
+    // Small bins hold a single size; large bins are kept sorted so the
+    // first fit within a bin is also the best fit
+    if (bin >= HEAP_SMALL_BINS) {
+        while (next && next->size < block->size) {
+            prev = next;
+            next = next->next_free;
+        }
+    }
+    
+    block->prev_free = prev;
+    block->next_free = next;
+    if (next) {
+        next->prev_free = block;
+    }
+    if (prev) {
+        prev->next_free = block;
+    } else {
+        free_bins[bin] = block;
+    }
+    bin_map[bin / 32] |= 1u << (bin % 32);
+}
+
+static void bin_remove(memory_block_t* block) {
+    uint32_t bin = size_to_bin(block->size);
+    
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        free_bins[bin] = block->next_free;
+    }
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    
+    if (!free_bins[bin]) {
+        bin_map[bin / 32] &= ~(1u << (bin % 32));
+    }
+}
+
+// Install a new top block. Its contents are unknown, so nothing is pre-zeroed.
+static void set_heap_top(memory_block_t* block) {
+    heap_top = block;
+    zero_lo = NULL;
+    zero_hi = NULL;
+}
+
+// Statistics class of a block size (sizes are multiples of 16)
+static uint32_t size_to_class(uint32_t size) {
+    uint32_t class = 31 - __builtin_clz(size | HEAP_BIN_STEP) - 4;
+    return class < HEAP_STAT_CLASSES ? class : HEAP_STAT_CLASSES - 1;
+}
+
+static void stat_alloc(uint32_t size, uint32_t tag) {
+    stats.class_allocs[size_to_class(size)]++;
+    if (total_allocated + large_bytes > stats.peak_used) {
+        stats.peak_used = total_allocated + large_bytes;
+    }
+    
+    mem_tag_stats_t* owner = &tag_stats[tag];
+    owner->allocs++;
+    owner->live_bytes += size;
+    if (owner->live_bytes > owner->peak_bytes) {
+        owner->peak_bytes = owner->live_bytes;
+    }
+}
+
+static void stat_free(uint32_t size, uint32_t tag) {
+    stats.class_frees[size_to_class(size)]++;
+    tag_stats[tag].frees++;
+    tag_stats[tag].live_bytes -= size;
+}
+
+// An allocation resized in place is still one allocation: only the bytes
+// change, and the class counters move if it changed class
+static void stat_resize(uint32_t old_size, uint32_t new_size, uint32_t tag) {
+    uint32_t old_class = size_to_class(old_size);
+    uint32_t new_class = size_to_class(new_size);
+    if (old_class != new_class) {
+        stats.class_frees[old_class]++;
+        stats.class_allocs[new_class]++;
+    }
+    if (total_allocated + large_bytes > stats.peak_used) {
+        stats.peak_used = total_allocated + large_bytes;
+    }
+    
+    mem_tag_stats_t* owner = &tag_stats[tag];
+    owner->live_bytes += new_size - old_size;
+    if (owner->live_bytes > owner->peak_bytes) {
+        owner->peak_bytes = owner->live_bytes;
+    }
+}
+
+static uint32_t large_slot(uint32_t addr) {
+    return ((addr / FRAME_SIZE) * 2654435761u) >> (32 - large_bits);
+}
+
+static large_entry_t* large_find(uint32_t addr) {
+    if (!large_table) {
+        return NULL;
+    }
+    
+    uint32_t mask = (1u << large_bits) - 1;
+    for (uint32_t i = large_slot(addr); large_table[i].addr; i = (i + 1) & mask) {
+        if (large_table[i].addr == addr) {
+            return &large_table[i];
+        }
+    }
+    return NULL;
+}
+
+static void large_insert(uint32_t addr, uint32_t frames, uint32_t tag) {
+    uint32_t mask = (1u << large_bits) - 1;
+    uint32_t i = large_slot(addr);
+    while (large_table[i].addr) {
+        i = (i + 1) & mask;
+    }
+    large_table[i].addr = addr;
+    large_table[i].frames = frames;
+    large_table[i].tag = tag;
+    large_count++;
+}
+
+// Empty a slot, shifting later entries of the same probe run back into it
+static void large_remove(large_entry_t* entry) {
+    uint32_t mask = (1u << large_bits) - 1;
+    uint32_t hole = entry - large_table;
+    
+    for (uint32_t i = (hole + 1) & mask; large_table[i].addr; i = (i + 1) & mask) {
+        uint32_t home = large_slot(large_table[i].addr);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            large_table[hole] = large_table[i];
+            hole = i;
+        }
+    }
+    large_table[hole].addr = 0;
+    large_count--;
+}
+
+// Make sure one more entry fits, doubling the table at half load
+static bool large_reserve(void) {
+    if (large_table && (large_count + 1) * 2 <= (1u << large_bits)) {
+        return true;
+    }
+    
+    uint32_t bits = large_table ? large_bits + 1 : LARGE_TABLE_MIN_BITS;
+    uint32_t frames = ((1u << bits) * sizeof(large_entry_t)) / FRAME_SIZE;
+    large_entry_t* table = (large_entry_t*)pmm_alloc_frames(frames);
+    if (!table) {
+        return false;
+    }
+    memset(table, 0, frames * FRAME_SIZE);
+    
+    large_entry_t* old = large_table;
+    uint32_t old_slots = old ? 1u << large_bits : 0;
+    large_table = table;
+    large_bits = bits;
+    large_count = 0;
+    for (uint32_t i = 0; i < old_slots; i++) {
+        if (old[i].addr) {
+            large_insert(old[i].addr, old[i].frames, old[i].tag);
+        }
+    }
+    if (old) {
+        pmm_free_frames((uint32_t)old, (old_slots * sizeof(large_entry_t)) / FRAME_SIZE);
+    }
+    return true;
+}
+
+// Page-direct allocation record for a pointer, if it is one
+static large_entry_t* large_lookup(void* ptr) {
+    if ((uint32_t)ptr & (FRAME_SIZE - 1)) {
+        return NULL; // Page-direct allocations always start on a frame
+    }
+    return large_find((uint32_t)ptr);
+}
+
+// Find the first non-empty bin at or above the given index
+static int bin_find_from(uint32_t bin) {
+    for (uint32_t word = bin / 32; word < HEAP_NUM_BINS / 32; word++) {
+        uint32_t bits = bin_map[word];
+        if (word == bin / 32) {
+            bits &= ~0u << (bin % 32);
+        }
+        if (bits) {
+            return word * 32 + __builtin_ctz(bits);
+        }
+    }
+    return -1;
+}
+
+// Return a free block to the bins, or keep it aside as the top
+static void release_block(memory_block_t* block) {
+    if (block == heap_top) {
+        return;
+    }
+    
+    if (!heap_top && block_next(block) == heap_epilogue) {
+        set_heap_top(block);
+    } else {
+        bin_insert(block);
+    }
+}
+
+// Carve a block down to size, returning the tail as a free block
+static void split_block(memory_block_t* block, uint32_t size) {
+    if (block->size < size + HEAP_OVERHEAD + HEAP_BIN_STEP) {
+        return;
+    }
+    
+    uint32_t remainder = block->size - size - HEAP_OVERHEAD;
+    block_set(block, size, block->is_free);
+    
+    memory_block_t* tail = block_next(block);
+    block_set(tail, remainder, true);
+    
+    if (block == heap_top) {
+        // The carved block's footer and the new header sit below the tail
+        uint8_t* payload = (uint8_t*)tail + HEAP_HEADER_SIZE;
+        heap_top = tail;
+        if (zero_lo < payload) {
+            zero_lo = zero_hi > payload ? payload : zero_hi;
+        }
+    } else {
+        release_block(tail);
+    }
+}
+
+// Merge a free block with its free neighbours and file it
+static void coalesce_block(memory_block_t* block) {
+    uint32_t size = block->size;
+    
+    // Merge with next block if it's free
+    memory_block_t* next = block_next(block);
+    if (next->is_free) {
+        if (next == heap_top) {
+            heap_top = block;
+        } else {
+            bin_remove(next);
+        }
+        size += next->size + HEAP_OVERHEAD;
+    }
+    
+    // Merge with previous block if it's free
+    if (block_prev_footer(block)->is_free) {
+        memory_block_t* prev = block_prev(block);
+        if (prev == heap_top) {
+            set_heap_top(NULL); // The region was just extended past the old top
+        } else {
+            bin_remove(prev);
+        }
+        if (block == heap_top) {
+            heap_top = prev;
+        }
+        size += prev->size + HEAP_OVERHEAD;
+        block = prev;
+    }
+    
+    block_set(block, size, true);
+    release_block(block);
+}
+
+// Add [base, base + length) to the heap. A region that starts right after
+// the newest one extends it; anything else becomes a separate region
+// bracketed by its own zero-size allocated prologue/epilogue tags.
+static void heap_add_region(uint32_t base, uint32_t length) {
+    memory_block_t* block;
+    uint32_t payload;
+    
+    if (heap_epilogue && (uint32_t)heap_epilogue + HEAP_HEADER_SIZE == base) {
+        // The old epilogue becomes the header of the new block
+        block = heap_epilogue;
+        payload = length - HEAP_OVERHEAD;
+    } else {
+        memory_footer_t* prologue = (memory_footer_t*)base;
+        prologue->size = 0;
+        prologue->is_free = false;
+        
+        block = (memory_block_t*)(base + HEAP_FOOTER_SIZE);
+        payload = length - HEAP_FOOTER_SIZE - HEAP_HEADER_SIZE - HEAP_OVERHEAD;
+        
+        // Only one block can sit against the newest epilogue
+        if (heap_top) {
+            bin_insert(heap_top);
+            set_heap_top(NULL);
+        }
+    }
+    
+    heap_epilogue = (memory_block_t*)(base + length - HEAP_HEADER_SIZE);
+    heap_epilogue->size = 0;
+    heap_epilogue->is_free = false;
+    
+    block_set(block, payload, false);
+    coalesce_block(block);
+    heap_size += length;
+}
+
+// Whether taking more frames keeps the heap within the shrink test's budget
+static bool within_budget(uint32_t frames) {
+    return !memory_budget || heap_size + large_bytes + frames * FRAME_SIZE <= memory_budget;
+}
+
+// Pull enough frames from the frame allocator to satisfy a request
+static bool heap_grow(uint32_t size) {
+    uint32_t length = size + HEAP_FOOTER_SIZE + HEAP_HEADER_SIZE + HEAP_OVERHEAD;
+    if (length < HEAP_GROW_MIN) {
+        length = HEAP_GROW_MIN;
+    }
+    
+    uint32_t frames = (length + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t base = within_budget(frames) ? pmm_alloc_frames(frames) : 0;
+    if (!base) {
+        // Short on memory: settle for exactly what the request needs
+        length = size + HEAP_FOOTER_SIZE + HEAP_HEADER_SIZE + HEAP_OVERHEAD;
+        frames = (length + FRAME_SIZE - 1) / FRAME_SIZE;
+        base = within_budget(frames) ? pmm_alloc_frames(frames) : 0;
+        if (!base) {
+            return false;
+        }
+    }
+    
+    heap_add_region(base, frames * FRAME_SIZE);
+    return true;
+}
 
 void memory_init(void) {
-    // Initialize the heap with a single free block
-    heap_start = (memory_block_t*)HEAP_START;
-    heap_start->size = HEAP_SIZE - sizeof(memory_block_t);
-    heap_start->is_free = true;
-    heap_start->next = NULL;
-    heap_start->prev = NULL;
+    for (int i = 0; i < HEAP_NUM_BINS; i++) {
+        free_bins[i] = NULL;
+    }
+    for (int i = 0; i < HEAP_NUM_BINS / 32; i++) {
+        bin_map[i] = 0;
+    }
+    set_heap_top(NULL);
+    heap_epilogue = NULL;
+    heap_size = 0;
+    large_table = NULL;
+    large_bits = 0;
+    large_count = 0;
+    large_bytes = 0;
+    memset(&stats, 0, sizeof(stats));
+    memset(tag_stats, 0, sizeof(tag_stats));
+    current_tag = MEM_TAG_KERNEL;
     
     memory_initialized = true;
     total_allocated = 0;
+    
+    heap_grow(HEAP_INITIAL_SIZE - HEAP_FOOTER_SIZE - HEAP_HEADER_SIZE - HEAP_OVERHEAD);
 }
 
-void* kmalloc(uint32_t size) {
+// Pick a free block for a rounded request, or NULL if none fits
+static memory_block_t* find_block(uint32_t size) {
+    uint32_t bin = size_to_bin(size);
+    memory_block_t* current = NULL;
+    
+    if (bin >= HEAP_SMALL_BINS) {
+        // Large bins hold a range of sizes, so search the exact bin first
+        for (memory_block_t* b = free_bins[bin]; b; b = b->next_free) {
+            stats.search_steps++;
+            if (b->size >= size) {
+                current = b;
+                break;
+            }
+        }
+        bin++;
+    }
+    
+    if (!current) {
+        // Any block in a higher bin is big enough, and the head of the
+        // lowest non-empty one is the smallest of them, so this is still
+        // the best fit
+        int found = bin < HEAP_NUM_BINS ? bin_find_from(bin) : -1;
+        if (found >= 0) {
+            current = free_bins[found];
+        }
+    }
+    
+    // The top is used last: carving it first grows the heap sooner and
+    // leaves fewer frames for page-sized allocations
+    if (current) {
+        bin_remove(current);
+    } else if (heap_top && heap_top->size >= size) {
+        current = heap_top;
+    }
+    
+    stats.search_steps++;
+    return current;
+}
+
+// Ask the shrinkers, highest priority first, to release memory until one
+// of them makes progress. Returns false once none has anything left.
+static bool heap_reclaim(uint32_t size) {
+    if (in_reclaim) {
+        return false; // A shrinker allocated; don't recurse
+    }
+    
+    in_reclaim = true;
+    stats.reclaim_runs++;
+    
+    bool progress = false;
+    for (uint32_t i = 0; i < shrinker_count && !progress; i++) {
+        uint32_t released = shrinkers[i].shrink(size + HEAP_OVERHEAD);
+        shrinkers[i].calls++;
+        shrinkers[i].released += released;
+        stats.reclaimed += released;
+        progress = released > 0;
+    }
+    
+    in_reclaim = false;
+    return progress;
+}
+
+bool memory_register_shrinker(const char* name, shrinker_fn_t shrink, uint32_t priority) {
+    if (!shrink || shrinker_count == SHRINKER_MAX) {
+        return false;
+    }
+    
+    // Insert after any shrinker of the same priority
+    uint32_t i = shrinker_count;
+    while (i > 0 && shrinkers[i - 1].priority > priority) {
+        shrinkers[i] = shrinkers[i - 1];
+        i--;
+    }
+    
+    shrinkers[i].name = name;
+    shrinkers[i].shrink = shrink;
+    shrinkers[i].priority = priority;
+    shrinkers[i].calls = 0;
+    shrinkers[i].released = 0;
+    shrinker_count++;
+    return true;
+}
+
+void memory_unregister_shrinker(shrinker_fn_t shrink) {
+    for (uint32_t i = 0; i < shrinker_count; i++) {
+        if (shrinkers[i].shrink == shrink) {
+            for (uint32_t j = i + 1; j < shrinker_count; j++) {
+                shrinkers[j - 1] = shrinkers[j];
+            }
+            shrinker_count--;
+            return;
+        }
+    }
+}
+
+// Zero a fresh allocation, skipping whatever memory_idle already cleared
+static void clear_allocation(uint8_t* start, uint32_t size, bool from_top) {
+    uint8_t* end = start + size;
+    uint8_t* lo = zero_lo > start ? zero_lo : start;
+    uint8_t* hi = zero_hi < end ? zero_hi : end;
+    
+    if (!from_top || lo >= hi) {
+        memset(start, 0, size);
+        stats.zero_misses++;
+        return;
+    }
+    
+    memset(start, 0, lo - start);
+    memset(hi, 0, end - hi);
+    if (lo == start && hi == end) {
+        stats.zero_hits++;
+    } else {
+        stats.zero_misses++;
+    }
+}
+
+// Move a found block's payload up to the given alignment by splitting off
+// its front as a free block of its own. The block must have room for the
+// worst-case lead (align + HEAP_OVERHEAD + HEAP_BIN_STEP bytes).
+static memory_block_t* align_block(memory_block_t* block, uint32_t align) {
+    uint32_t payload = (uint32_t)block + HEAP_HEADER_SIZE;
+    if ((payload & (align - 1)) == 0) {
+        return block;
+    }
+    
+    // The lead must be big enough to stand as a free block
+    uint32_t aligned = (payload + HEAP_OVERHEAD + HEAP_BIN_STEP + align - 1) & ~(align - 1);
+    uint32_t lead = aligned - payload - HEAP_OVERHEAD;
+    memory_block_t* rest = (memory_block_t*)(aligned - HEAP_HEADER_SIZE);
+    block_set(rest, block->size - lead - HEAP_OVERHEAD, true);
+    block_set(block, lead, true);
+    
+    if (block == heap_top) {
+        heap_top = rest;
+        if (zero_lo < (uint8_t*)aligned) {
+            zero_lo = zero_hi > (uint8_t*)aligned ? (uint8_t*)aligned : zero_hi;
+        }
+    }
+    bin_insert(block);
+    return rest;
+}
+
+// Frames for a page-direct allocation, with room for its table entry
+static uint32_t large_take(uint32_t frames) {
+    return within_budget(frames) && large_reserve() ? pmm_alloc_frames(frames) : 0;
+}
+
+// Serve a request with whole frames, bypassing the heap. Alignments above a
+// frame over-allocate and give the unused frames on either side back.
+static void* large_alloc(uint32_t size, uint32_t align, bool zero, uint32_t tag) {
+    uint32_t frames = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t extra = align > FRAME_SIZE ? align / FRAME_SIZE - 1 : 0;
+    
+    uint32_t base = large_take(frames + extra);
+    
+    // Out of frames: hand back the free end of the heap, then ask the shrinkers
+    if (!base && memory_trim()) {
+        base = large_take(frames + extra);
+    }
+    while (!base && heap_reclaim(size)) {
+        memory_trim();
+        base = large_take(frames + extra);
+    }
+    
+    if (!base) {
+        stats.failed_allocs++;
+        return NULL;
+    }
+    
+    uint32_t addr = base;
+    if (extra) {
+        addr = (base + align - 1) & ~(align - 1);
+        uint32_t before = (addr - base) / FRAME_SIZE;
+        if (before) {
+            pmm_free_frames(base, before);
+        }
+        if (extra > before) {
+            pmm_free_frames(addr + frames * FRAME_SIZE, extra - before);
+        }
+    }
+    
+    large_insert(addr, frames, tag);
+    large_bytes += frames * FRAME_SIZE;
+    stats.large_allocs++;
+    stat_alloc(frames * FRAME_SIZE, tag);
+    
+    if (zero) {
+        memset((void*)addr, 0, frames * FRAME_SIZE);
+    }
+    return (void*)addr;
+}
+
+static void large_free(large_entry_t* entry) {
+    uint32_t bytes = entry->frames * FRAME_SIZE;
+    large_bytes -= bytes;
+    stats.free_calls++;
+    stat_free(bytes, entry->tag);
+    pmm_free_frames(entry->addr, entry->frames);
+    large_remove(entry);
+}
+
+static void* heap_alloc(uint32_t size, uint32_t align, bool zero, uint32_t tag) {
     if (!memory_initialized) {
         memory_init();
     }
     
-    if (size == 0) {
+    stats.alloc_calls++;
+    if (size == 0 || size > 0x80000000) {
+        stats.failed_allocs++;
         return NULL;
     }
     
-    // Align to 4-byte boundary
-    size = (size + 3) & ~3;
-    
-    memory_block_t* current = heap_start;
-    
-    // Find a free block that's large enough
-    while (current) {
-        if (current->is_free && current->size >= size) {
-            // Split the block if it's significantly larger
-            if (current->size > size + sizeof(memory_block_t) + 32) {
-                memory_block_t* new_block = (memory_block_t*)((uint8_t*)current + sizeof(memory_block_t) + size);
-                new_block->size = current->size - size - sizeof(memory_block_t);
-                new_block->is_free = true;
-                new_block->next = current->next;
-                new_block->prev = current;
-                
-                if (current->next) {
-                    current->next->prev = new_block;
-                }
-                current->next = new_block;
-                current->size = size;
-            }
-            
-            current->is_free = false;
-            total_allocated += current->size;
-            
-            // Return pointer to the data area (after the header)
-            return (uint8_t*)current + sizeof(memory_block_t);
+    // Big requests get frames of their own instead of carving up the heap
+    if (size >= HEAP_LARGE_THRESHOLD || align >= FRAME_SIZE) {
+        return large_alloc(size, align, zero, tag);
+    }
+    
+    // Round up to the size-class step, and look for enough room to move
+    // the payload up to a stricter alignment
+    size = (size + HEAP_BIN_STEP - 1) & ~(HEAP_BIN_STEP - 1);
+    uint32_t request = size;
+    if (align > HEAP_BIN_STEP) {
+        request += align + HEAP_OVERHEAD + HEAP_BIN_STEP;
+    }
+    
+    // Big zeroed requests go straight to the pre-zeroed front of the top
+    // block when it is large enough: no search and nothing to clear
+    memory_block_t* current = NULL;
+    if (zero && size >= HEAP_SMALL_LIMIT && request == size && heap_top &&
+        zero_lo == (uint8_t*)heap_top + HEAP_HEADER_SIZE &&
+        (uint32_t)(zero_hi - zero_lo) >= size) {
+        current = heap_top;
+    } else {
+        current = find_block(request);
+    }
+    if (!current && heap_grow(request)) {
+        current = find_block(request);
+    }
+    
+    // Out of memory: reclaim from the shrinkers and try again
+    while (!current && heap_reclaim(request)) {
+        current = find_block(request);
+        if (!current && heap_grow(request)) {
+            current = find_block(request);
         }
-        current = current->next;
     }
     
-    return NULL; // Out of memory
+    if (!current) {
+        stats.failed_allocs++;
+        return NULL; // Out of memory
+    }
+    
+    if (request != size) {
+        current = align_block(current, align);
+    }
+    
+    uint8_t* payload = (uint8_t*)current + HEAP_HEADER_SIZE;
+    if (zero) {
+        clear_allocation(payload, size, current == heap_top);
+    }
+    
+    split_block(current, size);
+    if (current == heap_top) {
+        set_heap_top(NULL);
+    }
+    
+    block_set(current, current->size, false);
+    current->tag = tag;
+    total_allocated += current->size;
+    stat_alloc(current->size, tag);
+    
+    // Return pointer to the data area (after the header)
+    return payload;
+}
+
+void* kmalloc(uint32_t size) {
+    return heap_alloc(size, HEAP_BIN_STEP, false, current_tag);
+}
+
+void* kzalloc(uint32_t size) {
+    return heap_alloc(size, HEAP_BIN_STEP, true, current_tag);
+}
+
+void* kmalloc_tagged(uint32_t size, mem_tag_t tag) {
+    return heap_alloc(size, HEAP_BIN_STEP, false, tag < MEM_TAG_COUNT ? tag : MEM_TAG_KERNEL);
+}
+
+void* kzalloc_tagged(uint32_t size, mem_tag_t tag) {
+    return heap_alloc(size, HEAP_BIN_STEP, true, tag < MEM_TAG_COUNT ? tag : MEM_TAG_KERNEL);
+}
+
+// Allocate without running the shrinkers: the heap may still grow from
+// free frames, but nothing else is asked to give memory back. For callers
+// that may have interrupted a subsystem midway, such as the page fault
+// handler.
+void* kmalloc_atomic(uint32_t size, mem_tag_t tag) {
+    bool reclaiming = in_reclaim;
+    in_reclaim = true; // heap_reclaim does nothing while this is set
+    void* ptr = heap_alloc(size, HEAP_BIN_STEP, false, tag < MEM_TAG_COUNT ? tag : MEM_TAG_KERNEL);
+    in_reclaim = reclaiming;
+    return ptr;
+}
+
+// Charge later allocations to a tag; returns the previous one so callers
+// can put it back when they are done
+mem_tag_t memory_set_tag(mem_tag_t tag) {
+    mem_tag_t previous = current_tag;
+    current_tag = tag < MEM_TAG_COUNT ? tag : MEM_TAG_KERNEL;
+    return previous;
+}
+
+void* kcalloc(uint32_t count, uint32_t size) {
+    if (size && count > 0xFFFFFFFF / size) {
+        return NULL;
+    }
+    return heap_alloc(count * size, HEAP_BIN_STEP, true, current_tag);
+}
+
+// Allocate with the payload aligned to a power of two. Below a page the size
+// is padded to a whole number of alignment units as well, so with
+// HEAP_CACHE_LINE the object shares no cache line with its neighbours.
+void* kmalloc_aligned(uint32_t size, uint32_t align) {
+    if (align & (align - 1)) {
+        return NULL;
+    }
+    if (align < HEAP_BIN_STEP) {
+        align = HEAP_BIN_STEP;
+    }
+    if (align < FRAME_SIZE && size <= 0x80000000) {
+        size = (size + align - 1) & ~(align - 1);
+    }
+    return heap_alloc(size, align, false, current_tag);
+}
+
+// Usable size of an allocation, which may exceed what was asked for
+uint32_t ksize(void* ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    large_entry_t* entry = large_lookup(ptr);
+    return entry ? entry->frames * FRAME_SIZE : block_from_ptr(ptr)->size;
+}
+
+// Background work for the idle loop: keep the top block at least
+// HEAP_ZERO_POOL bytes and clear one more page of it, so kzalloc can hand
+// it out without touching it. Returns false when there is nothing to do.
+bool memory_idle(void) {
+    if (!memory_initialized) {
+        return false;
+    }
+    
+    // Keep the pool stocked by growing the heap, but only while the heap is
+    // nearly full; otherwise the top would keep absorbing frames the free
+    // blocks could have served
+    uint32_t top_size = heap_top ? heap_top->size : 0;
+    if (top_size < HEAP_ZERO_POOL &&
+        heap_size - total_allocated < 2 * HEAP_ZERO_POOL &&
+        pmm_get_free_frames() > 4 * (HEAP_ZERO_POOL / FRAME_SIZE)) {
+        return heap_grow(HEAP_ZERO_POOL - top_size);
+    }
+    if (!heap_top) {
+        return false;
+    }
+    
+    uint8_t* start = (uint8_t*)heap_top + HEAP_HEADER_SIZE;
+    uint8_t* end = start + heap_top->size;
+    if (zero_lo == zero_hi) {
+        zero_lo = start;
+        zero_hi = start;
+    }
+    if ((uint32_t)(zero_hi - zero_lo) >= HEAP_ZERO_POOL) {
+        return false;
+    }
+    
+    // Grow the zeroed range towards the start first, since that's where
+    // the next allocation is carved from
+    if (zero_lo > start) {
+        uint32_t length = zero_lo - start < PAGE_SIZE ? (uint32_t)(zero_lo - start) : PAGE_SIZE;
+        zero_lo -= length;
+        memset(zero_lo, 0, length);
+    } else if (zero_hi < end) {
+        uint32_t length = end - zero_hi < PAGE_SIZE ? (uint32_t)(end - zero_hi) : PAGE_SIZE;
+        memset(zero_hi, 0, length);
+        zero_hi += length;
+    } else {
+        return false;
+    }
+    return true;
 }
 
 void kfree(void* ptr) {
@@ -70,33 +846,64 @@ void kfree(void* ptr) {
         return;
     }
     
+    large_entry_t* entry = large_lookup(ptr);
+    if (entry) {
+        large_free(entry);
+        return;
+    }
+    
     // Get the block header
-    memory_block_t* block = (memory_block_t*)((uint8_t*)ptr - sizeof(memory_block_t));
+    memory_block_t* block = block_from_ptr(ptr);
     
     if (block->is_free) {
         return; // Already freed
     }
     
-    block->is_free = true;
     total_allocated -= block->size;
+    stats.free_calls++;
+    stat_free(block->size, block->tag);
+    coalesce_block(block);
+}
+
+// Trim an allocated block to size, handing the tail back to the heap
+static void shrink_block(memory_block_t* block, uint32_t size) {
+    if (block->size < size + HEAP_OVERHEAD + HEAP_BIN_STEP) {
+        return;
+    }
     
-    // Merge with next block if it's free
-    if (block->next && block->next->is_free) {
-        block->size += block->next->size + sizeof(memory_block_t);
-        if (block->next->next) {
-            block->next->next->prev = block;
+    uint32_t remainder = block->size - size - HEAP_OVERHEAD;
+    total_allocated -= block->size - size;
+    block_set(block, size, false);
+    
+    memory_block_t* tail = block_next(block);
+    block_set(tail, remainder, false);
+    coalesce_block(tail);
+}
+
+// Resize a page-direct allocation. Shrinking keeps it in place and frees
+// the frames past the new end; anything else moves it.
+static void* large_realloc(large_entry_t* entry, uint32_t new_size) {
+    void* ptr = (void*)entry->addr;
+    uint32_t old_bytes = entry->frames * FRAME_SIZE;
+    
+    if (new_size >= HEAP_LARGE_THRESHOLD && new_size <= old_bytes) {
+        uint32_t frames = (new_size + FRAME_SIZE - 1) / FRAME_SIZE;
+        if (frames < entry->frames) {
+            pmm_free_frames(entry->addr + frames * FRAME_SIZE, entry->frames - frames);
+            large_bytes -= (entry->frames - frames) * FRAME_SIZE;
+            entry->frames = frames;
+            stat_resize(old_bytes, frames * FRAME_SIZE, entry->tag);
         }
-        block->next = block->next->next;
+        return ptr;
     }
     
-    // Merge with previous block if it's free
-    if (block->prev && block->prev->is_free) {
-        block->prev->size += block->size + sizeof(memory_block_t);
-        if (block->next) {
-            block->next->prev = block->prev;
-        }
-        block->prev->next = block->next;
+    // Allocating may grow the table, so the entry is not used past this point
+    void* new_ptr = heap_alloc(new_size, HEAP_BIN_STEP, false, entry->tag);
+    if (new_ptr) {
+        memcpy(new_ptr, ptr, new_size < old_bytes ? new_size : old_bytes);
+        kfree(ptr);
     }
+    return new_ptr;
 }
 
 void* krealloc(void* ptr, uint32_t new_size) {
@@ -109,32 +916,157 @@ void* krealloc(void* ptr, uint32_t new_size) {
         return NULL;
     }
     
-    memory_block_t* block = (memory_block_t*)((uint8_t*)ptr - sizeof(memory_block_t));
+    if (new_size > 0x80000000) {
+        return NULL;
+    }
     
-    if (block->size >= new_size) {
-        return ptr; // Current block is large enough
+    large_entry_t* entry = large_lookup(ptr);
+    if (entry) {
+        return large_realloc(entry, new_size);
+    }
+    
+    memory_block_t* block = block_from_ptr(ptr);
+    uint32_t old_size = block->size;
+    uint32_t size = (new_size + HEAP_BIN_STEP - 1) & ~(HEAP_BIN_STEP - 1);
+    
+    if (size <= old_size) {
+        shrink_block(block, size);
+        stat_resize(old_size, block->size, block->tag);
+        return ptr;
+    }
+    
+    // Grow in place by absorbing a free successor
+    memory_block_t* next = block_next(block);
+    if (next->is_free && old_size + HEAP_OVERHEAD + next->size >= size) {
+        if (next == heap_top) {
+            set_heap_top(NULL);
+        } else {
+            bin_remove(next);
+        }
+        block_set(block, old_size + HEAP_OVERHEAD + next->size, false);
+        total_allocated += block->size - old_size;
+        shrink_block(block, size);
+        stat_resize(old_size, block->size, block->tag);
+        return ptr;
     }
     
     // Allocate new block and copy data
-    void* new_ptr = kmalloc(new_size);
+    void* new_ptr = heap_alloc(new_size, HEAP_BIN_STEP, false, block->tag);
     if (new_ptr) {
-        memcpy(new_ptr, ptr, block->size < new_size ? block->size : new_size);
+        memcpy(new_ptr, ptr, old_size);
         kfree(ptr);
     }
     
     return new_ptr;
 }
 
+// Give the whole frames inside a free block other than the top back to the
+// frame allocator. What is left on either side stays a free block, closed
+// off by a new epilogue or prologue tag, so the hole splits its region in
+// two; a side that already ends its region goes with the frames.
+static uint32_t trim_block(memory_block_t* block) {
+    uint32_t start = (uint32_t)block;
+    memory_block_t* next = block_next(block);
+    uint32_t end = (uint32_t)next;
+    memory_footer_t* prev = block_prev_footer(block);
+    bool at_start = prev->size == 0 && !prev->is_free;
+    bool at_end = next->size == 0 && !next->is_free;
+    
+    uint32_t lo = at_start ? (uint32_t)prev
+                           : (start + HEAP_OVERHEAD + HEAP_BIN_STEP + HEAP_HEADER_SIZE + FRAME_SIZE - 1)
+                             & ~(FRAME_SIZE - 1);
+    uint32_t hi = at_end ? end + HEAP_HEADER_SIZE
+                         : (end - HEAP_FOOTER_SIZE - HEAP_OVERHEAD - HEAP_BIN_STEP) & ~(FRAME_SIZE - 1);
+    if (lo >= hi) {
+        return 0;
+    }
+    
+    bin_remove(block);
+    if (!at_start) {
+        memory_block_t* epilogue = (memory_block_t*)(lo - HEAP_HEADER_SIZE);
+        block_set(block, lo - HEAP_HEADER_SIZE - HEAP_OVERHEAD - start, true);
+        epilogue->size = 0;
+        epilogue->is_free = false;
+        bin_insert(block);
+    }
+    if (!at_end) {
+        memory_footer_t* prologue = (memory_footer_t*)hi;
+        prologue->size = 0;
+        prologue->is_free = false;
+        memory_block_t* tail = (memory_block_t*)(hi + HEAP_FOOTER_SIZE);
+        block_set(tail, end - (uint32_t)tail - HEAP_OVERHEAD, true);
+        bin_insert(tail);
+    }
+    
+    heap_size -= hi - lo;
+    pmm_free_frames(lo, (hi - lo) / FRAME_SIZE);
+    return hi - lo;
+}
+
+// Return whole free frames to the frame allocator: the free end of the
+// newest region, then any in free blocks elsewhere in the heap. The heap
+// otherwise keeps every frame it has ever grown into.
+uint32_t memory_trim(void) {
+    if (!memory_initialized) {
+        return 0;
+    }
+    
+    // A block smaller than a frame can still be all that is left of a
+    // region. The pieces a trimmed block leaves behind hold no whole frame,
+    // so revisiting them releases nothing.
+    uint32_t released = 0;
+    for (uint32_t bin = 0; bin < HEAP_NUM_BINS; bin++) {
+        memory_block_t* block = free_bins[bin];
+        while (block) {
+            memory_block_t* next = block->next_free;
+            released += trim_block(block);
+            block = next;
+        }
+    }
+    
+    if (!heap_top || block_next(heap_top) != heap_epilogue) {
+        return released;
+    }
+    
+    // Keep a minimal top block plus its footer and the epilogue
+    uint32_t payload = (uint32_t)heap_top + HEAP_HEADER_SIZE;
+    uint32_t end = (uint32_t)heap_epilogue + HEAP_HEADER_SIZE;
+    uint32_t new_end = (payload + HEAP_BIN_STEP + HEAP_FOOTER_SIZE + HEAP_HEADER_SIZE + FRAME_SIZE - 1)
+                       & ~(FRAME_SIZE - 1);
+    if (new_end >= end) {
+        return released;
+    }
+    
+    heap_epilogue = (memory_block_t*)(new_end - HEAP_HEADER_SIZE);
+    heap_epilogue->size = 0;
+    heap_epilogue->is_free = false;
+    block_set(heap_top, new_end - HEAP_HEADER_SIZE - HEAP_FOOTER_SIZE - payload, true);
+    
+    // The footer now sits inside what used to be the zeroed range
+    uint8_t* footer = (uint8_t*)block_footer(heap_top);
+    if (zero_hi > footer) {
+        zero_hi = footer;
+    }
+    if (zero_lo > zero_hi) {
+        zero_lo = zero_hi;
+    }
+    
+    heap_size -= end - new_end;
+    pmm_free_frames(new_end, (end - new_end) / FRAME_SIZE);
+    return released + end - new_end;
+}
+
+// Totals include page-direct allocations; the free figure is the heap's own
 uint32_t memory_get_total(void) {
-    return HEAP_SIZE;
+    return heap_size + large_bytes;
 }
 
 uint32_t memory_get_used(void) {
-    return total_allocated;
+    return total_allocated + large_bytes;
 }
 
 uint32_t memory_get_free(void) {
-    return HEAP_SIZE - total_allocated;
+    return heap_size - total_allocated;
 }
 
 void memory_print_stats(void) {
@@ -142,59 +1074,275 @@ void memory_print_stats(void) {
     screen_println("Memory Statistics:");
     screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     
+    screen_print("Physical memory: ");
+    print_number(pmm_get_total_frames() / 256);
+    screen_print(" MB (");
+    print_number(pmm_get_free_frames() / 256);
+    screen_println(" MB free)");
+    
     screen_print("Total heap size: ");
-    print_number(HEAP_SIZE / 1024);
+    print_number(heap_size / 1024);
     screen_println(" KB");
     
     screen_print("Used memory: ");
     print_number(total_allocated);
     screen_println(" bytes");
     
+    screen_print("Page-direct: ");
+    print_number(large_count);
+    screen_print(" allocations, ");
+    print_number(large_bytes / 1024);
+    screen_println(" KB");
+    
     screen_print("Free memory: ");
     print_number(memory_get_free());
     screen_println(" bytes");
     
     screen_print("Usage: ");
-    if (HEAP_SIZE > 0) {
-        print_number((total_allocated * 100) / HEAP_SIZE);
+    if (heap_size > 0) {
+        print_number((total_allocated / 1024 * 100) / (heap_size / 1024));
         screen_println("%");
     } else {
         screen_println("0%");
     }
+    
+    memory_print_tag_stats();
 }
 
-// Utility functions
-void* memcpy(void* dest, const void* src, uint32_t n) {
-    uint8_t* d = (uint8_t*)dest;
-    const uint8_t* s = (const uint8_t*)src;
+void memory_get_tag_stats(mem_tag_t tag, mem_tag_stats_t* out) {
+    if (tag >= MEM_TAG_COUNT) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    *out = tag_stats[tag];
+    out->name = tag_names[tag];
+}
+
+void memory_print_tag_stats(void) {
+    screen_set_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK);
+    screen_println("  TAG        LIVE        PEAK        ALLOCS      FREES");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     
-    for (uint32_t i = 0; i < n; i++) {
-        d[i] = s[i];
+    for (int tag = 0; tag < MEM_TAG_COUNT; tag++) {
+        mem_tag_stats_t* owner = &tag_stats[tag];
+        screen_print("  ");
+        screen_print(tag_names[tag]);
+        uint32_t length = 0;
+        while (tag_names[tag][length]) {
+            length++;
+        }
+        for (; length < 11; length++) {
+            screen_print(" ");
+        }
+        print_column(owner->live_bytes, " B", 12);
+        print_column(owner->peak_bytes, " B", 12);
+        print_column(owner->allocs, "", 12);
+        print_number(owner->frees);
+        screen_println("");
     }
+}
+
+void memory_get_stats(heap_stats_t* out) {
+    *out = stats;
+    out->free_blocks = 0;
+    out->free_bytes = 0;
+    out->largest_free = 0;
+    out->zero_pool = heap_top ? (uint32_t)(zero_hi - zero_lo) : 0;
+    out->large_live = large_count;
+    out->large_bytes = large_bytes;
     
-    return dest;
+    // Every free block is either in a bin or the top
+    for (int bin = 0; bin <= HEAP_NUM_BINS; bin++) {
+        memory_block_t* b = bin < HEAP_NUM_BINS ? free_bins[bin] : heap_top;
+        for (; b; b = bin < HEAP_NUM_BINS ? b->next_free : NULL) {
+            out->free_blocks++;
+            out->free_bytes += b->size;
+            out->class_free_blocks[size_to_class(b->size)]++;
+            if (b->size > out->largest_free) {
+                out->largest_free = b->size;
+            }
+        }
+    }
 }
 
-void* memset(void* ptr, int value, uint32_t n) {
-    uint8_t* p = (uint8_t*)ptr;
+void memory_print_heap_stats(void) {
+    static heap_stats_t snapshot;
+    memory_get_stats(&snapshot);
     
-    for (uint32_t i = 0; i < n; i++) {
-        p[i] = (uint8_t)value;
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("Heap Statistics:");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    screen_print("Heap: ");
+    print_number(heap_size / 1024);
+    screen_print(" KB  Used: ");
+    print_number(total_allocated);
+    screen_print(" B  Peak: ");
+    print_number(snapshot.peak_used);
+    screen_println(" B");
+    
+    screen_print("Free: ");
+    print_number(snapshot.free_bytes);
+    screen_print(" B in ");
+    print_number(snapshot.free_blocks);
+    screen_print(" blocks  Largest: ");
+    print_number(snapshot.largest_free);
+    screen_println(" B");
+    
+    // Share of free space that can't be handed out as one block
+    screen_print("Fragmentation: ");
+    uint32_t largest = snapshot.largest_free;
+    uint32_t free = snapshot.free_bytes;
+    while (free > 0x1000000) {
+        largest >>= 4;  // Keep largest * 100 within 32 bits
+        free >>= 4;
     }
+    print_number(free ? 100 - largest * 100 / free : 0);
+    screen_println("%");
     
-    return ptr;
+    screen_print("kmalloc: ");
+    print_number(snapshot.alloc_calls);
+    screen_print("  kfree: ");
+    print_number(snapshot.free_calls);
+    screen_print("  failed: ");
+    print_number(snapshot.failed_allocs);
+    screen_print("  avg search: ");
+    uint32_t searches = snapshot.alloc_calls - snapshot.failed_allocs;
+    uint32_t avg = searches ? snapshot.search_steps * 10 / searches : 0;
+    print_number(avg / 10);
+    screen_print(".");
+    print_number(avg % 10);
+    screen_println("");
+    
+    screen_print("Reclaim: ");
+    print_number(snapshot.reclaim_runs);
+    screen_print(" runs, ");
+    print_number(snapshot.reclaimed / 1024);
+    screen_print(" KB released by");
+    for (uint32_t i = 0; i < shrinker_count; i++) {
+        screen_print(" ");
+        screen_print(shrinkers[i].name);
+    }
+    screen_println("");
+    
+    screen_print("Page-direct: ");
+    print_number(snapshot.large_live);
+    screen_print(" live, ");
+    print_number(snapshot.large_bytes / 1024);
+    screen_print(" KB  total: ");
+    print_number(snapshot.large_allocs);
+    screen_println("");
+    
+    screen_print("kzalloc pool: ");
+    print_number(snapshot.zero_pool / 1024);
+    screen_print(" KB zeroed  hits: ");
+    print_number(snapshot.zero_hits);
+    screen_print("  misses: ");
+    print_number(snapshot.zero_misses);
+    screen_println("");
+    
+    screen_set_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK);
+    screen_println("  CLASS          ALLOCS      FREES       LIVE        FREE BLOCKS");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    for (int c = 0; c < HEAP_STAT_CLASSES; c++) {
+        uint32_t allocs = snapshot.class_allocs[c];
+        uint32_t frees = snapshot.class_frees[c];
+        uint32_t blocks = snapshot.class_free_blocks[c];
+        if (!allocs && !blocks) {
+            continue;
+        }
+        
+        uint32_t low = 16u << c;
+        screen_print("  ");
+        if (low >= 1024 * 1024) {
+            print_column(low / (1024 * 1024), "M+", 15);
+        } else if (low >= 1024) {
+            print_column(low / 1024, "K+", 15);
+        } else {
+            print_column(low, "+", 15);
+        }
+        print_column(allocs, "", 12);
+        print_column(frees, "", 12);
+        print_column(allocs - frees, "", 12);
+        print_number(blocks);
+        screen_println("");
+    }
 }
 
-int memcmp(const void* ptr1, const void* ptr2, uint32_t n) {
-    const uint8_t* p1 = (const uint8_t*)ptr1;
-    const uint8_t* p2 = (const uint8_t*)ptr2;
+// Reclaimable blocks owned by the shrink test, chained through their first word
+#define SHRINK_TEST_BUDGET  0x400000   // Let the heap take 4MB more than it has
+#define SHRINK_TEST_CHUNK   0x10000    // Fill that 64KB at a time
+#define SHRINK_TEST_REQUEST 0x40000    // Then ask for 256KB
+static void* shrink_test_list = NULL;
+
+static uint32_t shrink_test_release(uint32_t wanted) {
+    uint32_t released = 0;
+    while (shrink_test_list && released < wanted) {
+        void* block = shrink_test_list;
+        shrink_test_list = *(void**)block;
+        released += ksize(block);
+        kfree(block);
+    }
+    return released;
+}
+
+// Fill a fixed budget until kmalloc fails, then check that a request
+// succeeds once a shrinker can give some of that memory back. The budget
+// leaves the rest of physical memory to everything else.
+void memory_run_shrink_test(void) {
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("Shrinker Test:");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    memory_trim();
+    memory_budget = heap_size + large_bytes + SHRINK_TEST_BUDGET;
+    uint32_t filled = 0;
+    void* block;
+    while ((block = kmalloc(SHRINK_TEST_CHUNK)) != NULL) {
+        *(void**)block = shrink_test_list;
+        shrink_test_list = block;
+        filled++;
+    }
+    screen_print("Filled the 4MB budget with ");
+    print_number(filled);
+    screen_print(" x 64KB, ");
+    print_number(pmm_get_free_frames() * (FRAME_SIZE / 1024));
+    screen_println(" KB of frames left");
+    
+    bool full = kmalloc(SHRINK_TEST_REQUEST) == NULL;
+    screen_print("256KB request without shrinker: ");
+    screen_println(full ? "failed (memory full)" : "succeeded");
     
-    for (uint32_t i = 0; i < n; i++) {
-        if (p1[i] < p2[i]) return -1;
-        if (p1[i] > p2[i]) return 1;
+    memory_register_shrinker("shrinktest", shrink_test_release, SHRINKER_PRIORITY_DATA);
+    uint32_t reclaimed = stats.reclaimed;
+    uint8_t* ptr = kmalloc(SHRINK_TEST_REQUEST);
+    if (ptr) {
+        memset(ptr, 0x5A, SHRINK_TEST_REQUEST);
     }
+    reclaimed = stats.reclaimed - reclaimed;
+    
+    screen_print("256KB request with shrinker: ");
+    screen_print(ptr ? "succeeded, " : "failed, ");
+    print_number(reclaimed / 1024);
+    screen_println(" KB reclaimed");
     
-    return 0;
+    kfree(ptr);
+    shrink_test_release(0xFFFFFFFF);
+    memory_unregister_shrinker(shrink_test_release);
+    memory_budget = 0;
+    uint32_t trimmed = memory_trim();
+    screen_print("Released everything, ");
+    print_number(trimmed / 1024);
+    screen_println(" KB returned to the frame allocator");
+    
+    if (full && ptr && reclaimed > 0) {
+        screen_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+        screen_println("PASS");
+    } else {
+        screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+        screen_println("FAIL");
+    }
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
 }
 
 // Helper function declaration (should be defined elsewhere)
@@ -221,4 +1369,17 @@ static void print_number(uint32_t num) {
         char str[2] = {buffer[j], '\0'};
         screen_print(str);
     }
+}
+
+// Print a number and suffix left-aligned in a column of the given width
+static void print_column(uint32_t num, const char* suffix, uint32_t width) {
+    uint32_t length = 1;
+    for (uint32_t v = num; v >= 10; v /= 10) length++;
+    for (const char* c = suffix; *c; c++) length++;
+    
+    print_number(num);
+    screen_print(suffix);
+    for (; length < width; length++) {
+        screen_print(" ");
+    }
 }
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "../include/paging.h"
+#include "../include/pmm.h"
+#include "../include/cpu.h"
+#include "../include/kernel.h"
+#include "../include/screen.h"
+#include "../include/zram.h"
+
+// Benchmark parameters: walk 16MB one cache line per page, several passes
+#define BENCH_SIZE      (16 * 1024 * 1024)
+#define BENCH_PAGES     (BENCH_SIZE / FRAME_SIZE)
+#define BENCH_PASSES    8
+
+static void print_number(uint32_t num);
+static void print_hex(uint32_t num);
+
+// Kernel page directory; page tables come from the frame allocator and are
+// reachable because all RAM is identity mapped
+static uint32_t page_directory[1024] __attribute__((aligned(4096)));
+static bool large_pages = false;
+static uint32_t global_flag = 0;
+
+static uint32_t* new_page_table(void) {
+    uint32_t* table = (uint32_t*)pmm_alloc_frame();
+    if (!table) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < 1024; i++) {
+        table[i] = 0;
+    }
+    return table;
+}
+
+uint32_t* paging_get_pte(uint32_t virt, bool create) {
+    uint32_t* pde = &page_directory[virt >> 22];
+    
+    if (!(*pde & PAGE_PRESENT)) {
+        if (!create) {
+            return NULL;
+        }
+        uint32_t* table = new_page_table();
+        if (!table) {
+            return NULL;
+        }
+        *pde = (uint32_t)table | PAGE_PRESENT | PAGE_WRITABLE;
+    } else if (*pde & PAGE_LARGE) {
+        if (!create) {
+            return NULL;
+        }
+        
+        // Split the 4MB page into 1024 4KB pages with the same attributes
+        uint32_t* table = new_page_table();
+        if (!table) {
+            return NULL;
+        }
+        uint32_t base = *pde & LARGE_PAGE_MASK;
+        uint32_t flags = *pde & 0xFFF & ~PAGE_LARGE;
+        for (uint32_t i = 0; i < 1024; i++) {
+            table[i] = (base + i * FRAME_SIZE) | flags;
+        }
+        *pde = (uint32_t)table | PAGE_PRESENT | PAGE_WRITABLE;
+        invlpg(virt & LARGE_PAGE_MASK);
+    }
+    
+    uint32_t* table = (uint32_t*)(*pde & PAGE_FRAME_MASK);
+    return &table[(virt >> 12) & 0x3FF];
+}
+
+bool paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t* pte = paging_get_pte(virt, true);
+    if (!pte) {
+        return false;
+    }
+    
+    *pte = (phys & PAGE_FRAME_MASK) | (flags & 0xFFF & ~PAGE_LARGE) | PAGE_PRESENT;
+    invlpg(virt);
+    return true;
+}
+
+bool paging_map_large(uint32_t virt, uint32_t phys, uint32_t flags) {
+    if (!large_pages || (virt & ~LARGE_PAGE_MASK) || (phys & ~LARGE_PAGE_MASK)) {
+        return false;
+    }
+    
+    uint32_t* pde = &page_directory[virt >> 22];
+    if ((*pde & PAGE_PRESENT) && !(*pde & PAGE_LARGE)) {
+        pmm_free_frame(*pde & PAGE_FRAME_MASK); // Drop the old page table
+    }
+    
+    *pde = phys | (flags & 0xFFF) | PAGE_PRESENT | PAGE_LARGE;
+    invlpg(virt);
+    return true;
+}
+
+// Map a range, using 4MB pages wherever both addresses line up
+bool paging_map_range(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags) {
+    uint32_t offset = 0;
+    
+    while (offset < size) {
+        uint32_t v = virt + offset;
+        uint32_t p = phys + offset;
+        
+        if (large_pages && !(v & ~LARGE_PAGE_MASK) && !(p & ~LARGE_PAGE_MASK) &&
+            size - offset >= LARGE_PAGE_SIZE) {
+            paging_map_large(v, p, flags);
+            offset += LARGE_PAGE_SIZE;
+        } else {
+            if (!paging_map_page(v, p, flags)) {
+                return false;
+            }
+            offset += FRAME_SIZE;
+        }
+    }
+    
+    return true;
+}
+
+void paging_unmap(uint32_t virt) {
+    uint32_t* pde = &page_directory[virt >> 22];
+    
+    if (*pde & PAGE_LARGE) {
+        *pde = 0;
+    } else {
+        uint32_t* pte = paging_get_pte(virt, false);
+        if (pte) {
+            *pte = 0;
+        }
+    }
+    invlpg(virt);
+}
+
+uint32_t paging_get_physical(uint32_t virt) {
+    uint32_t pde = page_directory[virt >> 22];
+    
+    if (!(pde & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (pde & PAGE_LARGE) {
+        return (pde & LARGE_PAGE_MASK) + (virt & ~LARGE_PAGE_MASK);
+    }
+    
+    uint32_t pte = ((uint32_t*)(pde & PAGE_FRAME_MASK))[(virt >> 12) & 0x3FF];
+    if (!(pte & PAGE_PRESENT)) {
+        return 0;
+    }
+    return (pte & PAGE_FRAME_MASK) + (virt & ~PAGE_FRAME_MASK);
+}
+
+bool paging_large_pages_enabled(void) {
+    return large_pages;
+}
+
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    
+    large_pages = (edx & CPUID_FEAT_EDX_PSE) != 0;
+    uint32_t cr4 = read_cr4();
+    if (large_pages) {
+        cr4 |= CR4_PSE;
+    }
+    if (edx & CPUID_FEAT_EDX_PGE) {
+        cr4 |= CR4_PGE;
+        global_flag = PAGE_GLOBAL;
+    }
+    write_cr4(cr4);
+    
+    for (int i = 0; i < 1024; i++) {
+        page_directory[i] = 0;
+    }
+    
+    // Identity map all RAM: kernel image, heap regions and page tables alike.
+    // With PSE this takes one TLB entry per 4MB instead of 1024.
+    uint32_t end = (pmm_get_memory_end() + LARGE_PAGE_SIZE - 1) & LARGE_PAGE_MASK;
+    if (end == 0) {
+        end = LARGE_PAGE_SIZE;
+    }
+    paging_map_range(0, 0, end, PAGE_WRITABLE | global_flag);
+    
+    write_cr3((uint32_t)page_directory);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+}
+
+void paging_fault_handler(uint32_t error, uint32_t address, uint32_t eip) {
+    // Pageable memory that was never touched or has been compressed
+    if (!(error & PAGE_FAULT_PRESENT) && zram_fault(address)) {
+        return;
+    }
+    
+    screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+    screen_print("Page fault at 0x");
+    print_hex(address);
+    screen_print(" (eip 0x");
+    print_hex(eip);
+    screen_print(", ");
+    screen_print((error & PAGE_FAULT_PRESENT) ? "protection" : "not present");
+    screen_print(", ");
+    screen_print((error & PAGE_FAULT_WRITE) ? "write" : "read");
+    screen_println(")");
+    
+    kernel_panic("Unhandled page fault");
+}
+
+// Touch one cache line in every page of the buffer, BENCH_PASSES times.
+// The line offset rotates so the walk does not hammer a single cache set.
+static uint32_t bench_walk(volatile uint8_t* base) {
+    uint32_t sum = 0;
+    uint64_t start = rdtsc();
+    
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        for (uint32_t page = 0; page < BENCH_PAGES; page++) {
+            sum += base[page * FRAME_SIZE + (page % 64) * 64];
+        }
+    }
+    
+    uint64_t cycles = rdtsc() - start;
+    (void)sum;
+    return (uint32_t)cycles / (BENCH_PASSES * BENCH_PAGES);
+}
+
+void paging_run_benchmark(void) {
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("TLB Benchmark (16MB walk, one line per page):");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    uint32_t phys = pmm_alloc_frames(BENCH_PAGES);
+    if (!phys) {
+        screen_println("Not enough contiguous memory for the benchmark.");
+        return;
+    }
+    
+    // The identity map covers the buffer with 4MB pages; alias it with 4KB ones
+    for (uint32_t page = 0; page < BENCH_PAGES; page++) {
+        if (!paging_map_page(PAGING_BENCH_WINDOW + page * FRAME_SIZE,
+                             phys + page * FRAME_SIZE, PAGE_WRITABLE)) {
+            screen_println("Failed to build the 4KB mapping.");
+            pmm_free_frames(phys, BENCH_PAGES);
+            return;
+        }
+    }
+    
+    // Warm both paths once so neither pays for first-touch effects
+    bench_walk((volatile uint8_t*)PAGING_BENCH_WINDOW);
+    bench_walk((volatile uint8_t*)phys);
+    
+    uint32_t small_cycles = bench_walk((volatile uint8_t*)PAGING_BENCH_WINDOW);
+    uint32_t large_cycles = bench_walk((volatile uint8_t*)phys);
+    
+    screen_print("4KB pages: ");
+    print_number(small_cycles);
+    screen_println(" cycles/access");
+    
+    screen_print(large_pages ? "4MB pages: " : "4MB pages: unavailable, identity map uses 4KB: ");
+    print_number(large_cycles);
+    screen_println(" cycles/access");
+    
+    for (uint32_t page = 0; page < BENCH_PAGES; page++) {
+        paging_unmap(PAGING_BENCH_WINDOW + page * FRAME_SIZE);
+    }
+    pmm_free_frames(phys, BENCH_PAGES);
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
+
+static void print_hex(uint32_t num) {
+    char hex_chars[] = "0123456789ABCDEF";
+    char buffer[9];
+    
+    for (int i = 7; i >= 0; i--) {
+        buffer[i] = hex_chars[num & 0xF];
+        num >>= 4;
+    }
+    buffer[8] = '\0';
+    
+    screen_print(buffer);
+}
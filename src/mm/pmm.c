@@ -0,0 +1,180 @@
+#include "../include/pmm.h"
+
+// End of the kernel image (from linker.ld)
+extern uint8_t kernel_end[];
+
+// One bit per 4KB frame, set while the frame is used or unusable
+static uint32_t frame_bitmap[PMM_MAX_FRAMES / 32];
+static uint32_t total_frames = 0;
+static uint32_t free_frames = 0;
+static uint32_t highest_frame = 0;  // One past the last usable frame
+static uint32_t search_hint = 0;    // Next-fit starting point
+
+static inline bool frame_test(uint32_t frame) {
+    return (frame_bitmap[frame / 32] >> (frame % 32)) & 1;
+}
+
+static inline void frame_set(uint32_t frame) {
+    frame_bitmap[frame / 32] |= 1u << (frame % 32);
+}
+
+static inline void frame_clear(uint32_t frame) {
+    frame_bitmap[frame / 32] &= ~(1u << (frame % 32));
+}
+
+// Release the whole frames inside [start, end)
+static void pmm_mark_free(uint32_t start, uint32_t end) {
+    uint32_t first = (start + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t last = end / FRAME_SIZE;
+    
+    for (uint32_t frame = first; frame < last; frame++) {
+        if (frame_test(frame)) {
+            frame_clear(frame);
+            total_frames++;
+            free_frames++;
+        }
+    }
+    
+    if (last > highest_frame) {
+        highest_frame = last;
+    }
+}
+
+// Mark every frame touching [start, end) as used
+void pmm_reserve_range(uint32_t start, uint32_t end) {
+    uint32_t first = start / FRAME_SIZE;
+    uint32_t last = (end + FRAME_SIZE - 1) / FRAME_SIZE;
+    
+    for (uint32_t frame = first; frame < last && frame < PMM_MAX_FRAMES; frame++) {
+        if (!frame_test(frame)) {
+            frame_set(frame);
+            free_frames--;
+        }
+    }
+}
+
+void pmm_init(multiboot_info_t* mbi) {
+    // Everything is unusable until the memory map says otherwise
+    for (uint32_t i = 0; i < PMM_MAX_FRAMES / 32; i++) {
+        frame_bitmap[i] = 0xFFFFFFFF;
+    }
+    total_frames = 0;
+    free_frames = 0;
+    highest_frame = 0;
+    
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        uint32_t offset = 0;
+        while (offset < mbi->mmap_length) {
+            multiboot_mmap_entry_t* entry = (multiboot_mmap_entry_t*)(mbi->mmap_addr + offset);
+            
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->addr < 0x100000000ULL) {
+                uint64_t end = entry->addr + entry->len;
+                if (end > 0x100000000ULL) {
+                    end = 0x100000000ULL - FRAME_SIZE;
+                }
+                pmm_mark_free((uint32_t)entry->addr, (uint32_t)end);
+            }
+            
+            offset += entry->size + sizeof(entry->size);
+        }
+    } else if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+        // No map: assume everything between 1MB and mem_upper is usable
+        pmm_mark_free(PMM_LOW_MEMORY, PMM_LOW_MEMORY + mbi->mem_upper * 1024);
+    }
+    
+    // Keep low memory, the kernel image, the boot information and any
+    // modules, which stay where the loader put them
+    pmm_reserve_range(0, (uint32_t)kernel_end);
+    pmm_reserve_range((uint32_t)mbi, (uint32_t)mbi + sizeof(multiboot_info_t));
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        pmm_reserve_range(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+    }
+    if (mbi->flags & MULTIBOOT_INFO_MODS) {
+        multiboot_module_t* modules = (multiboot_module_t*)mbi->mods_addr;
+        pmm_reserve_range(mbi->mods_addr, mbi->mods_addr + mbi->mods_count * sizeof(multiboot_module_t));
+        for (uint32_t i = 0; i < mbi->mods_count; i++) {
+            pmm_reserve_range(modules[i].mod_start, modules[i].mod_end);
+        }
+    }
+    
+    search_hint = PMM_LOW_MEMORY / FRAME_SIZE;
+}
+
+// Find 'count' consecutive free frames in [from, highest_frame)
+static uint32_t find_free_run(uint32_t from, uint32_t count) {
+    uint32_t run = 0;
+    
+    for (uint32_t frame = from; frame < highest_frame; frame++) {
+        // Skip fully used words quickly
+        if ((frame % 32) == 0 && frame_bitmap[frame / 32] == 0xFFFFFFFF) {
+            run = 0;
+            frame += 31;
+            continue;
+        }
+        
+        if (frame_test(frame)) {
+            run = 0;
+        } else if (++run == count) {
+            return frame + 1 - count;
+        }
+    }
+    
+    return 0; // Frame 0 is always reserved, so 0 means not found
+}
+
+uint32_t pmm_alloc_frames(uint32_t count) {
+    if (count == 0 || count > free_frames) {
+        return 0;
+    }
+    
+    uint32_t first = find_free_run(search_hint, count);
+    if (!first) {
+        first = find_free_run(PMM_LOW_MEMORY / FRAME_SIZE, count);
+    }
+    if (!first) {
+        return 0; // No contiguous run that large
+    }
+    
+    for (uint32_t frame = first; frame < first + count; frame++) {
+        frame_set(frame);
+    }
+    free_frames -= count;
+    search_hint = first + count;
+    
+    return first * FRAME_SIZE;
+}
+
+uint32_t pmm_alloc_frame(void) {
+    return pmm_alloc_frames(1);
+}
+
+void pmm_free_frames(uint32_t addr, uint32_t count) {
+    uint32_t first = addr / FRAME_SIZE;
+    
+    for (uint32_t frame = first; frame < first + count && frame < highest_frame; frame++) {
+        if (frame_test(frame)) {
+            frame_clear(frame);
+            free_frames++;
+        }
+    }
+    
+    if (first < search_hint) {
+        search_hint = first;
+    }
+}
+
+void pmm_free_frame(uint32_t addr) {
+    pmm_free_frames(addr, 1);
+}
+
+uint32_t pmm_get_total_frames(void) {
+    return total_frames;
+}
+
+uint32_t pmm_get_free_frames(void) {
+    return free_frames;
+}
+
+uint32_t pmm_get_memory_end(void) {
+    return highest_frame * FRAME_SIZE;
+}
@@ -0,0 +1,264 @@
+#include "../include/slab.h"
+#include "../include/pmm.h"
+#include "../include/memory.h"
+#include "../include/screen.h"
+
+static void print_number(uint32_t num);
+
+// Cache descriptors
+static kmem_cache_t caches[SLAB_MAX_CACHES];
+
+// Bytes before the first object for a slab holding 'count' objects
+static uint32_t slab_header_size(uint32_t count) {
+    uint32_t size = sizeof(slab_t) + count * sizeof(uint16_t);
+    return (size + SLAB_CACHE_LINE - 1) & ~(SLAB_CACHE_LINE - 1);
+}
+
+static void slab_list_remove(slab_t** list, slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+static void slab_list_push(slab_t** list, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+// The list a slab belongs on for its current fill level
+static slab_t** slab_list_for(kmem_cache_t* cache, slab_t* slab) {
+    if (slab->in_use == 0) {
+        return &cache->empty;
+    }
+    if (slab->in_use == cache->objects_per_slab) {
+        return &cache->full;
+    }
+    return &cache->partial;
+}
+
+static slab_t* slab_create(kmem_cache_t* cache) {
+    slab_t* slab = (slab_t*)pmm_alloc_frame();
+    if (!slab) {
+        return NULL;
+    }
+    
+    slab->cache = cache;
+    slab->objects = (uint8_t*)slab + slab_header_size(cache->objects_per_slab);
+    slab->in_use = 0;
+    slab->free_head = 0;
+    
+    for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+        slab->free_index[i] = (i + 1 < cache->objects_per_slab) ? i + 1 : SLAB_END;
+        if (cache->ctor) {
+            cache->ctor(slab->objects + i * cache->object_size);
+        }
+    }
+    
+    slab_list_push(&cache->empty, slab);
+    cache->slab_count++;
+    return slab;
+}
+
+static void slab_release(kmem_cache_t* cache, slab_t* slab) {
+    slab_list_remove(slab_list_for(cache, slab), slab);
+    cache->slab_count--;
+    pmm_free_frame((uint32_t)slab);
+}
+
+// Shrinker: hand every cache's empty slabs back to the frame allocator
+static uint32_t slab_shrink(uint32_t wanted) {
+    (void)wanted; // Empty slabs are cheap to rebuild, so release them all
+    
+    uint32_t released = 0;
+    for (int i = 0; i < SLAB_MAX_CACHES; i++) {
+        if (caches[i].in_use) {
+            released += kmem_cache_shrink(&caches[i]);
+        }
+    }
+    return released;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size, uint32_t align, kmem_ctor_t ctor) {
+    static bool shrinker_registered = false;
+    if (!shrinker_registered) {
+        shrinker_registered = memory_register_shrinker("slab", slab_shrink, SHRINKER_PRIORITY_CACHE);
+    }
+    
+    if (align < SLAB_MIN_ALIGN) {
+        align = SLAB_MIN_ALIGN;
+    }
+    if (size == 0 || size > SLAB_MAX_OBJECT || (align & (align - 1)) || align > SLAB_CACHE_LINE) {
+        return NULL;
+    }
+    
+    kmem_cache_t* cache = NULL;
+    for (int i = 0; i < SLAB_MAX_CACHES; i++) {
+        if (!caches[i].in_use) {
+            cache = &caches[i];
+            break;
+        }
+    }
+    if (!cache) {
+        return NULL; // No free cache descriptors
+    }
+    
+    cache->name = name;
+    cache->object_size = (size + align - 1) & ~(align - 1);
+    cache->ctor = ctor;
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->slab_count = 0;
+    cache->active_objects = 0;
+    cache->in_use = true;
+    
+    // Fit as many objects as the page allows once the header is accounted for
+    uint32_t count = (FRAME_SIZE - sizeof(slab_t)) / (cache->object_size + sizeof(uint16_t));
+    while (slab_header_size(count) + count * cache->object_size > FRAME_SIZE) {
+        count--;
+    }
+    cache->objects_per_slab = count;
+    
+    return cache;
+}
+
+void kmem_cache_destroy(kmem_cache_t* cache) {
+    if (!cache || !cache->in_use) {
+        return;
+    }
+    
+    while (cache->full) {
+        slab_release(cache, cache->full);
+    }
+    while (cache->partial) {
+        slab_release(cache, cache->partial);
+    }
+    while (cache->empty) {
+        slab_release(cache, cache->empty);
+    }
+    cache->in_use = false;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    if (!cache) {
+        return NULL;
+    }
+    
+    slab_t* slab = cache->partial ? cache->partial : cache->empty;
+    if (!slab) {
+        slab = slab_create(cache);
+        if (!slab) {
+            return NULL; // Out of memory
+        }
+    }
+    
+    slab_list_remove(slab_list_for(cache, slab), slab);
+    
+    uint16_t index = slab->free_head;
+    slab->free_head = slab->free_index[index];
+    slab->in_use++;
+    cache->active_objects++;
+    
+    slab_list_push(slab_list_for(cache, slab), slab);
+    return slab->objects + index * cache->object_size;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* object) {
+    if (!cache || !object) {
+        return;
+    }
+    
+    // Slabs are single pages, so the header is at the page boundary
+    slab_t* slab = (slab_t*)((uint32_t)object & ~(FRAME_SIZE - 1));
+    if (slab->cache != cache) {
+        return; // Not from this cache
+    }
+    
+    slab_list_remove(slab_list_for(cache, slab), slab);
+    
+    uint16_t index = ((uint8_t*)object - slab->objects) / cache->object_size;
+    slab->free_index[index] = slab->free_head;
+    slab->free_head = index;
+    slab->in_use--;
+    cache->active_objects--;
+    
+    // Keep one empty slab around for the next allocation burst
+    if (slab->in_use == 0 && cache->empty) {
+        cache->slab_count--;
+        pmm_free_frame((uint32_t)slab);
+        return;
+    }
+    
+    slab_list_push(slab_list_for(cache, slab), slab);
+}
+
+uint32_t kmem_cache_shrink(kmem_cache_t* cache) {
+    uint32_t released = 0;
+    while (cache && cache->empty) {
+        slab_release(cache, cache->empty);
+        released += FRAME_SIZE;
+    }
+    return released;
+}
+
+void kmem_cache_print_stats(void) {
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("Slab Caches:");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    screen_println("  NAME            OBJSIZE  ACTIVE  PER-SLAB  SLABS");
+    
+    for (int i = 0; i < SLAB_MAX_CACHES; i++) {
+        kmem_cache_t* cache = &caches[i];
+        if (!cache->in_use) {
+            continue;
+        }
+        
+        screen_print("  ");
+        screen_print(cache->name);
+        int len = 0;
+        while (cache->name[len]) len++;
+        for (int pad = len; pad < 16; pad++) {
+            screen_print(" ");
+        }
+        print_number(cache->object_size);
+        screen_print("       ");
+        print_number(cache->active_objects);
+        screen_print("       ");
+        print_number(cache->objects_per_slab);
+        screen_print("        ");
+        print_number(cache->slab_count);
+        screen_println("");
+    }
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
@@ -0,0 +1,657 @@
+#include "../include/zram.h"
+#include "../include/lz4.h"
+#include "../include/memory.h"
+#include "../include/paging.h"
+#include "../include/cpu.h"
+#include "../include/kernel.h"
+#include "../include/screen.h"
+
+#define ZRAM_NO_SLOT        0xFFFFFFFF
+#define ZRAM_MIN_SLOTS      64
+#define ZRAM_MAX_SLOTS      (1u << (32 - PTE_ZRAM_SLOT_SHIFT))
+#define ZRAM_RESERVE_PAGES  8          // Frames set aside for evictions the heap can't take
+
+static void print_number(uint32_t num);
+
+// A page in the store. Free slots have no data and chain through 'length'.
+typedef struct {
+    uint8_t* data;
+    uint32_t length;
+} zram_slot_t;
+
+static bool zram_enabled = false;
+
+// Window pages handed out by zram_alloc, one bit each
+static uint32_t window_map[ZRAM_WINDOW_PAGES / 32];
+static uint32_t window_hint = 0;
+
+// Resident window pages in the order the clock hand visits them
+static uint32_t resident[ZRAM_RESIDENT_LIMIT];
+static uint32_t resident_count = 0;
+static uint32_t clock_hand = 0;
+
+// Every allocated window page has a slot ready, so an eviction never has
+// to grow the array from the page fault handler
+static zram_slot_t* slots = NULL;
+static uint32_t slot_capacity = 0;
+static uint32_t slot_free = ZRAM_NO_SLOT;
+
+// Frames taken at init for evicted pages when the heap has no room. The
+// fault handler must not run the shrinkers, so this is what it falls back
+// on; a frame comes back here when its page is loaded again.
+static uint8_t* reserve_frames[ZRAM_RESERVE_PAGES];
+static uint8_t* reserve_free[ZRAM_RESERVE_PAGES];
+static uint32_t reserve_count = 0;
+static uint32_t reserve_total = 0;
+
+static uint8_t compress_buffer[ZRAM_MAX_COMPRESSED];
+static uint8_t fpu_state[512] __attribute__((aligned(16)));
+
+// Counters; the averages are derived in zram_get_stats
+static zram_stats_t stats;
+static uint64_t fault_cycles = 0;
+static uint64_t compress_cycles = 0;
+
+void zram_init(void) {
+    // The window must not overlap the identity map of RAM
+    zram_enabled = pmm_get_memory_end() <= ZRAM_WINDOW;
+    
+    while (zram_enabled && reserve_total < ZRAM_RESERVE_PAGES) {
+        uint8_t* frame = (uint8_t*)pmm_alloc_frame();
+        if (!frame) {
+            break;
+        }
+        reserve_frames[reserve_total++] = frame;
+        reserve_free[reserve_count++] = frame;
+    }
+}
+
+bool zram_available(void) {
+    return zram_enabled;
+}
+
+static bool window_test(uint32_t page) {
+    return (window_map[page / 32] >> (page % 32)) & 1;
+}
+
+static void window_mark(uint32_t first, uint32_t count, bool used) {
+    for (uint32_t page = first; page < first + count; page++) {
+        if (used) {
+            window_map[page / 32] |= 1u << (page % 32);
+        } else {
+            window_map[page / 32] &= ~(1u << (page % 32));
+        }
+    }
+}
+
+// First run of 'count' free window pages at or after 'from'
+static uint32_t window_find_run(uint32_t from, uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t page = from; page < ZRAM_WINDOW_PAGES; page++) {
+        run = window_test(page) ? 0 : run + 1;
+        if (run == count) {
+            return page + 1 - count;
+        }
+    }
+    return ZRAM_WINDOW_PAGES;
+}
+
+// Grow the slot array to at least count slots. Called outside the fault
+// handler, by zram_alloc, so it may allocate normally.
+static bool slot_reserve(uint32_t count) {
+    if (count <= slot_capacity) {
+        return true;
+    }
+    uint32_t capacity = slot_capacity ? slot_capacity : ZRAM_MIN_SLOTS;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    if (capacity > ZRAM_MAX_SLOTS) {
+        return false;
+    }
+    
+    zram_slot_t* grown = slots ? krealloc(slots, capacity * sizeof(zram_slot_t))
+                               : kmalloc_tagged(capacity * sizeof(zram_slot_t), MEM_TAG_ZRAM);
+    if (!grown) {
+        return false;
+    }
+    
+    // Chain the new slots in ascending order ahead of the old free ones
+    for (uint32_t i = slot_capacity; i < capacity; i++) {
+        grown[i].data = NULL;
+        grown[i].length = i + 1 < capacity ? i + 1 : slot_free;
+    }
+    slot_free = slot_capacity;
+    slots = grown;
+    slot_capacity = capacity;
+    return true;
+}
+
+static uint32_t slot_alloc(void) {
+    uint32_t slot = slot_free;
+    if (slot != ZRAM_NO_SLOT) {
+        slot_free = slots[slot].length;
+    }
+    return slot;
+}
+
+static bool reserve_holds(const uint8_t* data) {
+    for (uint32_t i = 0; i < reserve_total; i++) {
+        if (reserve_frames[i] == data) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Memory a stored page takes: its heap block, or a whole reserve frame
+static uint32_t slot_footprint(const zram_slot_t* entry) {
+    return reserve_holds(entry->data) ? FRAME_SIZE : ksize(entry->data);
+}
+
+static void slot_release(uint32_t slot) {
+    zram_slot_t* entry = &slots[slot];
+    stats.stored_pages--;
+    stats.stored_bytes -= entry->length;
+    stats.store_footprint -= slot_footprint(entry);
+    if (entry->length == FRAME_SIZE) {
+        stats.raw_pages--;
+    }
+    
+    if (reserve_holds(entry->data)) {
+        reserve_free[reserve_count++] = entry->data;
+        stats.reserve_pages--;
+    } else {
+        kfree(entry->data);
+    }
+    entry->data = NULL;
+    entry->length = slot_free;
+    slot_free = slot;
+}
+
+// Move a resident page into the store and give its frame back. All-zero
+// pages need no storage; they go back to being fresh zero pages. Runs in
+// the page fault handler, which may have interrupted any subsystem, so the
+// copy comes from kmalloc_atomic or the reserve and never from reclaim.
+static bool store_page(uint32_t virt, uint32_t* pte) {
+    uint64_t start = rdtsc();
+    uint32_t frame = *pte & PAGE_FRAME_MASK;
+    const uint32_t* words = (const uint32_t*)frame;
+    
+    uint32_t i = 0;
+    while (i < FRAME_SIZE / 4 && words[i] == 0) {
+        i++;
+    }
+    
+    if (i == FRAME_SIZE / 4) {
+        *pte = PTE_ZRAM_ZERO;
+        stats.zero_evictions++;
+    } else {
+        const uint8_t* data = compress_buffer;
+        uint32_t length = lz4_compress((const uint8_t*)frame, FRAME_SIZE,
+                                       compress_buffer, ZRAM_MAX_COMPRESSED);
+        if (!length) {
+            data = (const uint8_t*)frame;
+            length = FRAME_SIZE;
+        }
+        
+        uint32_t slot = slot_alloc();
+        if (slot == ZRAM_NO_SLOT) {
+            return false;
+        }
+        uint8_t* copy = kmalloc_atomic(length, MEM_TAG_ZRAM);
+        if (!copy && reserve_count) {
+            copy = reserve_free[--reserve_count];
+            stats.reserve_pages++;
+        }
+        if (!copy) {
+            slots[slot].length = slot_free;
+            slot_free = slot;
+            return false;
+        }
+        memcpy(copy, data, length);
+        
+        slots[slot].data = copy;
+        slots[slot].length = length;
+        stats.stored_pages++;
+        stats.stored_bytes += length;
+        stats.store_footprint += slot_footprint(&slots[slot]);
+        if (length == FRAME_SIZE) {
+            stats.raw_pages++;
+        }
+        *pte = (slot << PTE_ZRAM_SLOT_SHIFT) | PTE_ZRAM_STORED;
+    }
+    
+    invlpg(virt);
+    pmm_free_frame(frame);
+    stats.evictions++;
+    compress_cycles += rdtsc() - start;
+    return true;
+}
+
+// Second-chance clock: a page used since the hand last passed loses its
+// accessed bit and is skipped once. Two sweeps always find a victim.
+static bool evict_one(void) {
+    for (uint32_t steps = 0; resident_count && steps < 2 * resident_count; steps++) {
+        if (clock_hand >= resident_count) {
+            clock_hand = 0;
+        }
+        
+        uint32_t virt = resident[clock_hand];
+        uint32_t* pte = paging_get_pte(virt, false);
+        if (*pte & PAGE_ACCESSED) {
+            *pte &= ~PAGE_ACCESSED;
+            invlpg(virt);
+            clock_hand++;
+            continue;
+        }
+        
+        if (!store_page(virt, pte)) {
+            return false;
+        }
+        resident[clock_hand] = resident[--resident_count];
+        return true;
+    }
+    return false;
+}
+
+// A frame for a page coming in, evicting first if the window is at its limit
+static uint32_t take_frame(void) {
+    if (resident_count >= ZRAM_RESIDENT_LIMIT && !evict_one()) {
+        return 0;
+    }
+    
+    uint32_t frame = pmm_alloc_frame();
+    while (!frame && evict_one()) {
+        frame = pmm_alloc_frame();
+    }
+    return frame;
+}
+
+static bool load_page(uint32_t virt, uint32_t* pte) {
+    uint32_t frame = take_frame();
+    if (!frame) {
+        return false;
+    }
+    
+    if (*pte & PTE_ZRAM_STORED) {
+        uint32_t slot = *pte >> PTE_ZRAM_SLOT_SHIFT;
+        zram_slot_t* entry = &slots[slot];
+        if (entry->length == FRAME_SIZE) {
+            memcpy((void*)frame, entry->data, FRAME_SIZE);
+        } else if (lz4_decompress(entry->data, entry->length, (uint8_t*)frame, FRAME_SIZE) != FRAME_SIZE) {
+            kernel_panic("zram: corrupt compressed page");
+        }
+        slot_release(slot);
+    } else {
+        memset((void*)frame, 0, FRAME_SIZE);
+    }
+    
+    *pte = frame | PAGE_PRESENT | PAGE_WRITABLE;
+    invlpg(virt);
+    resident[resident_count++] = virt;
+    return true;
+}
+
+// Called from the page fault handler. Returns false if the address is not
+// a pageable page, or no frame could be found for it.
+bool zram_fault(uint32_t address) {
+    if (!zram_enabled || address - ZRAM_WINDOW >= ZRAM_WINDOW_SIZE) {
+        return false;
+    }
+    
+    uint32_t virt = address & PAGE_FRAME_MASK;
+    uint32_t* pte = paging_get_pte(virt, false);
+    if (!pte || (*pte & PAGE_PRESENT) || !(*pte & (PTE_ZRAM_ZERO | PTE_ZRAM_STORED))) {
+        return false;
+    }
+    
+    // The faulting code may be in the middle of an SSE copy, and copying
+    // pages in and out uses SSE as well
+    bool save_fpu = cpu_has_sse2();
+    if (save_fpu) {
+        fxsave(fpu_state);
+    }
+    
+    uint64_t start = rdtsc();
+    bool loaded = load_page(virt, pte);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    
+    stats.faults++;
+    fault_cycles += cycles;
+    if (cycles > stats.fault_cycles_max) {
+        stats.fault_cycles_max = cycles;
+    }
+    
+    if (save_fpu) {
+        fxrstor(fpu_state);
+    }
+    return loaded;
+}
+
+// Reserve pages of pageable memory. They read as zero and take no frame
+// until touched.
+void* zram_alloc(uint32_t pages) {
+    if (!zram_enabled || pages == 0 || pages > ZRAM_WINDOW_PAGES) {
+        return NULL;
+    }
+    
+    uint32_t first = window_find_run(window_hint, pages);
+    if (first == ZRAM_WINDOW_PAGES) {
+        first = window_find_run(0, pages);
+    }
+    if (first == ZRAM_WINDOW_PAGES || !slot_reserve(stats.allocated_pages + pages)) {
+        return NULL;
+    }
+    
+    uint32_t base = ZRAM_WINDOW + first * FRAME_SIZE;
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t* pte = paging_get_pte(base + i * FRAME_SIZE, true);
+        if (!pte) {
+            while (i--) {
+                *paging_get_pte(base + i * FRAME_SIZE, false) = 0;
+            }
+            return NULL;
+        }
+        *pte = PTE_ZRAM_ZERO;
+    }
+    
+    window_mark(first, pages, true);
+    window_hint = first + pages;
+    stats.allocated_pages += pages;
+    return (void*)base;
+}
+
+void zram_free(void* addr, uint32_t pages) {
+    uint32_t base = (uint32_t)addr;
+    if (!zram_enabled || !addr || base - ZRAM_WINDOW >= ZRAM_WINDOW_SIZE) {
+        return;
+    }
+    
+    uint32_t first = (base - ZRAM_WINDOW) / FRAME_SIZE;
+    for (uint32_t i = 0; i < pages && first + i < ZRAM_WINDOW_PAGES; i++) {
+        uint32_t virt = base + i * FRAME_SIZE;
+        uint32_t* pte = paging_get_pte(virt, false);
+        if (!pte || !window_test(first + i)) {
+            continue;
+        }
+        
+        if (*pte & PAGE_PRESENT) {
+            pmm_free_frame(*pte & PAGE_FRAME_MASK);
+            for (uint32_t r = 0; r < resident_count; r++) {
+                if (resident[r] == virt) {
+                    resident[r] = resident[--resident_count];
+                    break;
+                }
+            }
+        } else if (*pte & PTE_ZRAM_STORED) {
+            slot_release(*pte >> PTE_ZRAM_SLOT_SHIFT);
+        }
+        *pte = 0;
+        invlpg(virt);
+        window_mark(first + i, 1, false);
+        stats.allocated_pages--;
+    }
+    if (first < window_hint) {
+        window_hint = first;
+    }
+}
+
+// Whether addr is in the pageable window, so came from zram_alloc
+bool zram_owns(const void* addr) {
+    return zram_enabled && (uint32_t)addr - ZRAM_WINDOW < ZRAM_WINDOW_SIZE;
+}
+
+// Add up where the pages of an allocation are, so a user of the window can
+// report what its data costs in RAM
+void zram_add_usage(const void* addr, uint32_t pages, zram_usage_t* usage) {
+    if (!zram_owns(addr)) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t* pte = paging_get_pte((uint32_t)addr + i * FRAME_SIZE, false);
+        if (!pte) {
+            continue;
+        }
+        if (*pte & PAGE_PRESENT) {
+            usage->resident_pages++;
+        } else if (*pte & PTE_ZRAM_STORED) {
+            usage->stored_pages++;
+            usage->stored_bytes += slot_footprint(&slots[*pte >> PTE_ZRAM_SLOT_SHIFT]);
+        } else if (*pte & PTE_ZRAM_ZERO) {
+            usage->zero_pages++;
+        }
+    }
+}
+
+// Average of a 64-bit total without 64-bit division
+static uint32_t average(uint64_t total, uint32_t count) {
+    while (total >> 32) {
+        total >>= 1;
+        count >>= 1;
+    }
+    return count ? (uint32_t)total / count : 0;
+}
+
+void zram_get_stats(zram_stats_t* out) {
+    *out = stats;
+    out->resident_pages = resident_count;
+    out->fault_cycles_avg = average(fault_cycles, stats.faults);
+    out->compress_cycles_avg = average(compress_cycles, stats.evictions);
+}
+
+void zram_print_stats(void) {
+    zram_stats_t snapshot;
+    zram_get_stats(&snapshot);
+    
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("Compressed Memory (zram):");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    if (!zram_enabled) {
+        screen_println("Unavailable: RAM reaches into the pageable window");
+        return;
+    }
+    
+    screen_print("Pages: ");
+    print_number(snapshot.allocated_pages);
+    screen_print(" allocated, ");
+    print_number(snapshot.resident_pages);
+    screen_print(" resident (limit ");
+    print_number(ZRAM_RESIDENT_LIMIT);
+    screen_print("), ");
+    print_number(snapshot.stored_pages);
+    screen_print(" stored (");
+    print_number(snapshot.raw_pages);
+    screen_print(" raw, ");
+    print_number(snapshot.reserve_pages);
+    screen_println(" in the reserve)");
+    
+    // Ratio of the data held to the heap it takes, in hundredths
+    uint32_t data_kb = snapshot.stored_pages * (FRAME_SIZE / 1024);
+    uint32_t store_kb = (snapshot.store_footprint + 1023) / 1024;
+    uint32_t ratio = store_kb ? data_kb * 100 / store_kb : 0;
+    screen_print("Store: ");
+    print_number(data_kb);
+    screen_print(" KB in ");
+    print_number(store_kb);
+    screen_print(" KB, ratio ");
+    print_number(ratio / 100);
+    screen_print(".");
+    if (ratio % 100 < 10) {
+        screen_print("0");
+    }
+    print_number(ratio % 100);
+    screen_println(":1");
+    
+    screen_print("Evictions: ");
+    print_number(snapshot.evictions);
+    screen_print(" (");
+    print_number(snapshot.zero_evictions);
+    screen_print(" zero)  avg ");
+    print_number(snapshot.compress_cycles_avg);
+    screen_println(" cycles");
+    
+    screen_print("Faults: ");
+    print_number(snapshot.faults);
+    screen_print("  avg ");
+    print_number(snapshot.fault_cycles_avg);
+    screen_print("  max ");
+    print_number(snapshot.fault_cycles_max);
+    screen_println(" cycles");
+}
+
+// Test data: one page in eight stays zero, one is random, the rest are
+// log lines that compress about as well as real logs do
+static void zram_test_page(uint8_t* page, uint32_t index) {
+    static const char* events[] = {
+        "fs: wrote block ", "shell: ran command ", "timer: tick ", "kbd: scancode "
+    };
+    uint32_t seed = index * 2654435761u + 1;
+    
+    if (index % 8 == 0) {
+        memset(page, 0, FRAME_SIZE);
+        return;
+    }
+    if (index % 8 == 1) {
+        for (uint32_t i = 0; i < FRAME_SIZE; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            page[i] = (uint8_t)seed;
+        }
+        return;
+    }
+    
+    uint32_t pos = 0;
+    uint32_t line = index * 64;
+    while (pos < FRAME_SIZE) {
+        char text[64];
+        uint32_t length = 0;
+        const char* event = events[(seed >> 8) % 4];
+        seed = seed * 1103515245 + 12345;
+        
+        char digits[10];
+        uint32_t count = 0;
+        text[length++] = '[';
+        for (uint32_t n = line++; count == 0 || n; n /= 10) {
+            digits[count++] = '0' + n % 10;
+        }
+        while (count) {
+            text[length++] = digits[--count];
+        }
+        text[length++] = ']';
+        text[length++] = ' ';
+        while (*event) {
+            text[length++] = *event++;
+        }
+        for (uint32_t n = (seed >> 16) % 1000; count == 0 || n; n /= 10) {
+            digits[count++] = '0' + n % 10;
+        }
+        while (count) {
+            text[length++] = digits[--count];
+        }
+        text[length++] = '\n';
+        
+        for (uint32_t i = 0; i < length && pos < FRAME_SIZE; i++) {
+            page[pos++] = text[i];
+        }
+    }
+}
+
+// Write a working set far larger than the resident limit, read it back,
+// and report how much memory the store needed to hold it
+void zram_run_test(uint32_t megabytes) {
+    static uint8_t expected[FRAME_SIZE];
+    
+    screen_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    screen_println("Compressed Memory Test:");
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    
+    uint32_t pages = megabytes * (1024 * 1024 / FRAME_SIZE);
+    uint8_t* region = zram_alloc(pages);
+    if (!region) {
+        screen_println("Could not reserve the pageable region.");
+        return;
+    }
+    
+    zram_stats_t before;
+    zram_get_stats(&before);
+    
+    for (uint32_t page = 0; page < pages; page++) {
+        if (page % 8 != 0) {
+            zram_test_page(region + page * FRAME_SIZE, page);
+        }
+    }
+    
+    zram_stats_t filled;
+    zram_get_stats(&filled);
+    
+    uint32_t errors = 0;
+    for (uint32_t page = 0; page < pages; page++) {
+        zram_test_page(expected, page);
+        if (memcmp(region + page * FRAME_SIZE, expected, FRAME_SIZE) != 0) {
+            errors++;
+        }
+    }
+    
+    zram_stats_t after;
+    zram_get_stats(&after);
+    
+    screen_print("Wrote and verified ");
+    print_number(megabytes);
+    screen_print(" MB with ");
+    print_number(ZRAM_RESIDENT_LIMIT * FRAME_SIZE / 1024);
+    screen_println(" KB resident");
+    
+    screen_print("After writing: ");
+    print_number(filled.stored_pages * (FRAME_SIZE / 1024));
+    screen_print(" KB stored in ");
+    print_number(filled.store_footprint / 1024);
+    screen_println(" KB of heap");
+    
+    screen_print("Faults: ");
+    print_number(after.faults - before.faults);
+    screen_print(" (avg ");
+    print_number(after.fault_cycles_avg);
+    screen_print(" cycles), evictions: ");
+    print_number(after.evictions - before.evictions);
+    screen_println("");
+    
+    zram_print_stats();
+    zram_free(region, pages);
+    
+    if (errors == 0) {
+        screen_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+        screen_println("PASS");
+    } else {
+        screen_set_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+        print_number(errors);
+        screen_println(" pages differ - FAIL");
+    }
+    screen_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+}
+
+// Simple number printing function (local implementation)
+static void print_number(uint32_t num) {
+    if (num == 0) {
+        screen_print("0");
+        return;
+    }
+    
+    char buffer[16];
+    int i = 0;
+    
+    // Convert number to string (reverse order)
+    while (num > 0) {
+        buffer[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+    
+    // Print in correct order
+    for (int j = i - 1; j >= 0; j--) {
+        char str[2] = {buffer[j], '\0'};
+        screen_print(str);
+    }
+}
@@ -6,6 +6,15 @@ if (!(Test-Path "trakos.iso")) {
     .\build.ps1
 }
 
+# Files are kept on this disk image between runs; a new one starts blank.
+# It is attached as a virtio disk; with if=ide the ATA driver takes it.
+if (!(Test-Path "disk.img")) {
+    Write-Host "Creating 32MB disk image..." -ForegroundColor Yellow
+    $disk = [System.IO.File]::Create("$PWD\disk.img")
+    $disk.SetLength(32MB)
+    $disk.Close()
+}
+
 Write-Host ""
 Write-Host "=== TRAK-OS ===" -ForegroundColor Cyan
 Write-Host "✅ Minimal kernel" -ForegroundColor Green
@@ -21,10 +30,10 @@ Write-Host ""
 # Try different emulators
 if (Get-Command qemu-system-i386 -ErrorAction SilentlyContinue) {
     Write-Host "Starting with QEMU..." -ForegroundColor Blue
-    qemu-system-i386 -cdrom trakos.iso -m 128
+    qemu-system-i386 -cdrom trakos.iso -drive file=disk.img,format=raw,if=virtio -boot d -m 128
 } elseif (Get-Command qemu-system-x86_64 -ErrorAction SilentlyContinue) {
     Write-Host "Starting with QEMU x86_64..." -ForegroundColor Blue
-    qemu-system-x86_64 -cdrom trakos.iso -m 128
+    qemu-system-x86_64 -cdrom trakos.iso -drive file=disk.img,format=raw,if=virtio -boot d -m 128
 } else {
     Write-Host "QEMU not found. You can run the ISO file manually:" -ForegroundColor Yellow
     Write-Host "  - Use VirtualBox, VMware, or any VM software" -ForegroundColor White
@@ -0,0 +1,426 @@
+// Hosted allocator benchmark. Links src/mm/memory.c into a Linux process,
+// backs the heap with a malloc'd arena and replays allocation traces
+// against it, reporting throughput, per-call latency and fragmentation.
+//
+//   heapbench [-n ops] [-s seed] [-m arena_mb] [-w out.trace] [-v] [trace...]
+//
+// A trace is one of the built-in generators (shell, fs, random, all) or a
+// file of recorded operations, one per line:
+//
+//   a <slot> <size>     kmalloc into slot
+//   f <slot>            kfree slot
+//   r <slot> <size>     krealloc slot
+//
+// Lines starting with '#' are ignored.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "heapbench.h"
+
+#define MAX_SLOTS       65536
+#define DEFAULT_OPS     200000
+#define DEFAULT_ARENA   64          // MB
+
+enum { OP_ALLOC, OP_FREE, OP_REALLOC, OP_KINDS };
+
+typedef struct {
+    unsigned char kind;
+    unsigned int slot;
+    unsigned int size;
+} op_t;
+
+typedef struct {
+    const char* name;
+    op_t* ops;
+    unsigned int count;
+    unsigned int capacity;
+} trace_t;
+
+// Arena standing in for physical memory
+static unsigned char* arena = NULL;
+static unsigned int arena_base = 0;
+static unsigned int arena_frames = 0;
+
+static void* slots[MAX_SLOTS];
+static unsigned int rng_state = 1;
+static int verbose = 0;
+
+void host_print(const char* str) {
+    fputs(str, stdout);
+}
+
+static unsigned int rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static unsigned int rng_range(unsigned int low, unsigned int high) {
+    return low + rng() % (high - low + 1);
+}
+
+static void trace_push(trace_t* trace, int kind, unsigned int slot, unsigned int size) {
+    if (trace->count == trace->capacity) {
+        trace->capacity = trace->capacity ? trace->capacity * 2 : 4096;
+        trace->ops = realloc(trace->ops, trace->capacity * sizeof(op_t));
+        if (!trace->ops) {
+            fprintf(stderr, "heapbench: out of memory\n");
+            exit(1);
+        }
+    }
+    op_t* op = &trace->ops[trace->count++];
+    op->kind = kind;
+    op->slot = slot;
+    op->size = size;
+}
+
+// Shell session: every command allocates a line buffer, a handful of
+// argument strings and an output buffer, and frees them when it returns.
+// A few results land in a bounded history that outlives the command.
+static void gen_shell(trace_t* trace, unsigned int ops) {
+    const unsigned int history = 64;
+    unsigned int history_next = 0;
+
+    while (trace->count < ops) {
+        unsigned int slot = history;
+        trace_push(trace, OP_ALLOC, slot++, 256);
+
+        unsigned int args = rng_range(1, 4);
+        for (unsigned int i = 0; i < args; i++) {
+            trace_push(trace, OP_ALLOC, slot++, rng_range(8, 64));
+        }
+        if (rng() % 4 == 0) {
+            trace_push(trace, OP_ALLOC, slot++, rng_range(64, 512));
+        }
+
+        if (rng() % 10 == 0) {
+            unsigned int h = history_next++ % history;
+            trace_push(trace, OP_FREE, h, 0);
+            trace_push(trace, OP_ALLOC, h, rng_range(32, 128));
+        }
+
+        while (slot > history) {
+            trace_push(trace, OP_FREE, --slot, 0);
+        }
+    }
+}
+
+// File system churn: files are created with a small entry and a data
+// buffer, grown by appends through krealloc and deleted at random.
+static void gen_fs(trace_t* trace, unsigned int ops) {
+    const unsigned int files = 128;
+    unsigned int size[128] = {0};
+
+    while (trace->count < ops) {
+        unsigned int f = rng() % files;
+        unsigned int entry = f * 2;
+        unsigned int data = f * 2 + 1;
+        unsigned int action = rng() % 10;
+
+        if (!size[f]) {
+            size[f] = rng_range(128, 2048);
+            trace_push(trace, OP_ALLOC, entry, 64);
+            trace_push(trace, OP_ALLOC, data, size[f]);
+        } else if (action < 6 && size[f] < 16384) {
+            size[f] += rng_range(64, 1024);
+            trace_push(trace, OP_REALLOC, data, size[f]);
+        } else if (action < 8) {
+            trace_push(trace, OP_FREE, data, 0);
+            trace_push(trace, OP_FREE, entry, 0);
+            size[f] = 0;
+        } else {
+            // Rewrite: truncate back to a fresh buffer
+            size[f] = rng_range(128, 2048);
+            trace_push(trace, OP_REALLOC, data, size[f]);
+        }
+    }
+}
+
+// Random sizes: a fixed population of live objects, each replaced in turn
+// by one of a mix of small, medium and large sizes.
+static void gen_random(trace_t* trace, unsigned int ops) {
+    const unsigned int population = 2000;
+
+    for (unsigned int i = 0; i < population && trace->count < ops; i++) {
+        trace_push(trace, OP_ALLOC, i, 0);
+    }
+    while (trace->count < ops) {
+        unsigned int slot = rng() % population;
+        trace_push(trace, OP_FREE, slot, 0);
+        trace_push(trace, OP_ALLOC, slot, 0);
+    }
+
+    for (unsigned int i = 0; i < trace->count; i++) {
+        if (trace->ops[i].kind == OP_ALLOC) {
+            unsigned int r = rng() % 100;
+            if (r < 70) {
+                trace->ops[i].size = rng_range(8, 256);
+            } else if (r < 95) {
+                trace->ops[i].size = rng_range(256, 4096);
+            } else {
+                trace->ops[i].size = rng_range(4096, 32768);
+            }
+        }
+    }
+}
+
+static int load_trace(trace_t* trace, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    char line[128];
+    unsigned int number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        char kind;
+        unsigned int slot;
+        unsigned int size = 0;
+        number++;
+
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, " %c %u %u", &kind, &slot, &size) < 2 || slot >= MAX_SLOTS) {
+            fprintf(stderr, "%s:%u: bad trace line\n", path, number);
+            fclose(file);
+            return -1;
+        }
+
+        switch (kind) {
+            case 'a': trace_push(trace, OP_ALLOC, slot, size); break;
+            case 'f': trace_push(trace, OP_FREE, slot, 0); break;
+            case 'r': trace_push(trace, OP_REALLOC, slot, size); break;
+            default:
+                fprintf(stderr, "%s:%u: unknown op '%c'\n", path, number, kind);
+                fclose(file);
+                return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int save_trace(const trace_t* trace, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    fprintf(file, "# %s, %u ops\n", trace->name, trace->count);
+    for (unsigned int i = 0; i < trace->count; i++) {
+        const op_t* op = &trace->ops[i];
+        switch (op->kind) {
+            case OP_ALLOC: fprintf(file, "a %u %u\n", op->slot, op->size); break;
+            case OP_FREE: fprintf(file, "f %u\n", op->slot); break;
+            case OP_REALLOC: fprintf(file, "r %u %u\n", op->slot, op->size); break;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// Start every replay from an empty heap on a fresh arena
+static void reset_heap(void) {
+    memset(slots, 0, sizeof(slots));
+    heapbench_reset(arena_base, arena_frames);
+}
+
+static void release_all(void) {
+    for (unsigned int i = 0; i < MAX_SLOTS; i++) {
+        if (slots[i]) {
+            kfree(slots[i]);
+            slots[i] = NULL;
+        }
+    }
+}
+
+static inline void run_op(const op_t* op) {
+    void** slot = &slots[op->slot];
+    switch (op->kind) {
+        case OP_ALLOC:
+            if (*slot) {
+                kfree(*slot);
+            }
+            *slot = kmalloc(op->size);
+            break;
+        case OP_FREE:
+            kfree(*slot);
+            *slot = NULL;
+            break;
+        case OP_REALLOC: {
+            void* moved = krealloc(*slot, op->size);
+            if (moved || op->size == 0) {
+                *slot = moved;
+            }
+            break;
+        }
+    }
+}
+
+static int compare_uint(const void* a, const void* b) {
+    unsigned int x = *(const unsigned int*)a;
+    unsigned int y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_latency(const char* label, unsigned int* samples, unsigned int count) {
+    if (!count) {
+        return;
+    }
+    qsort(samples, count, sizeof(unsigned int), compare_uint);
+    printf("  %-14s p50 %u  p99 %u cycles (%u calls)\n", label,
+           samples[count / 2], samples[(unsigned long long)count * 99 / 100], count);
+}
+
+static void replay(const trace_t* trace) {
+    static const char* labels[OP_KINDS] = { "kmalloc", "kfree", "krealloc" };
+    unsigned int* latency[OP_KINDS];
+    unsigned int samples[OP_KINDS] = {0};
+
+    // Pass 1: throughput, no per-call instrumentation
+    reset_heap();
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < trace->count; i++) {
+        run_op(&trace->ops[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    release_all();
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Pass 2: per-call latency in cycles, then the heap state it leaves
+    for (int k = 0; k < OP_KINDS; k++) {
+        latency[k] = malloc(trace->count * sizeof(unsigned int));
+    }
+    reset_heap();
+    for (unsigned int i = 0; i < trace->count; i++) {
+        const op_t* op = &trace->ops[i];
+        unsigned long long t0 = __rdtsc();
+        run_op(op);
+        unsigned long long t1 = __rdtsc();
+        latency[op->kind][samples[op->kind]++] = (unsigned int)(t1 - t0);
+    }
+
+    heapbench_heap_t heap;
+    heapbench_snapshot(&heap);
+
+    printf("== %s (%u ops) ==\n", trace->name, trace->count);
+    printf("  %-14s %.2f Mops/s\n", "throughput", seconds > 0 ? trace->count / seconds / 1e6 : 0.0);
+    for (int k = 0; k < OP_KINDS; k++) {
+        print_latency(labels[k], latency[k], samples[k]);
+    }
+    printf("  %-14s %u\n", "failed allocs", heap.failed_allocs);
+    printf("  %-14s %u KB, peak used %u KB, live %u KB\n", "heap",
+           heap.heap_size / 1024, heap.peak_used / 1024, heap.used / 1024);
+    printf("  %-14s %u%% (largest free %u KB of %u KB, %u blocks)\n", "fragmentation",
+           heap.free_bytes ? 100 - (unsigned int)(100.0 * heap.largest_free / heap.free_bytes) : 0,
+           heap.largest_free / 1024, heap.free_bytes / 1024, heap.free_blocks);
+    printf("  %-14s %.2f blocks per kmalloc\n", "search",
+           heap.alloc_calls ? (double)heap.search_steps / heap.alloc_calls : 0.0);
+    if (verbose) {
+        heapbench_print_heap();
+    }
+    printf("\n");
+
+    release_all();
+    for (int k = 0; k < OP_KINDS; k++) {
+        free(latency[k]);
+    }
+}
+
+static int build_trace(trace_t* trace, const char* name, unsigned int ops, unsigned int seed) {
+    memset(trace, 0, sizeof(*trace));
+    trace->name = name;
+    rng_state = seed;
+
+    if (strcmp(name, "shell") == 0) {
+        gen_shell(trace, ops);
+    } else if (strcmp(name, "fs") == 0) {
+        gen_fs(trace, ops);
+    } else if (strcmp(name, "random") == 0) {
+        gen_random(trace, ops);
+    } else if (load_trace(trace, name) != 0) {
+        fprintf(stderr, "heapbench: can't load trace '%s'\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: heapbench [-n ops] [-s seed] [-m arena_mb] [-w out.trace] [-v] [shell|fs|random|all|file...]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    unsigned int ops = DEFAULT_OPS;
+    unsigned int seed = 12345;
+    unsigned int arena_mb = DEFAULT_ARENA;
+    const char* write_path = NULL;
+    const char* names[64];
+    int name_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            ops = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            arena_mb = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            write_path = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else if (strcmp(argv[i], "all") == 0 && name_count + 3 <= 64) {
+            names[name_count++] = "shell";
+            names[name_count++] = "fs";
+            names[name_count++] = "random";
+        } else if (name_count < 64) {
+            names[name_count++] = argv[i];
+        }
+    }
+    if (name_count == 0) {
+        names[name_count++] = "shell";
+        names[name_count++] = "fs";
+        names[name_count++] = "random";
+    }
+    if (write_path && name_count != 1) {
+        fprintf(stderr, "heapbench: -w takes exactly one trace\n");
+        return 2;
+    }
+
+    // The heap stores addresses in 32-bit fields, so this must be a 32-bit build
+    arena_frames = arena_mb * 256;
+    arena = malloc((size_t)arena_frames * 4096 + 4096);
+    if (!arena) {
+        fprintf(stderr, "heapbench: can't allocate a %u MB arena\n", arena_mb);
+        return 1;
+    }
+    arena_base = ((unsigned int)(size_t)arena + 4095) & ~4095u;
+
+    for (int i = 0; i < name_count; i++) {
+        trace_t trace;
+        if (build_trace(&trace, names[i], ops, seed) != 0) {
+            return 1;
+        }
+        if (write_path) {
+            if (save_trace(&trace, write_path) != 0) {
+                fprintf(stderr, "heapbench: can't write '%s'\n", write_path);
+                return 1;
+            }
+        }
+        replay(&trace);
+        free(trace.ops);
+    }
+
+    free(arena);
+    return 0;
+}
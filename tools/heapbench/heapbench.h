@@ -0,0 +1,35 @@
+#ifndef HEAPBENCH_H
+#define HEAPBENCH_H
+
+// Interface between the hosted benchmark (built against libc) and the
+// kernel-side glue (built against src/include). Only plain C types are used
+// here because the kernel's types.h and the libc headers can't be mixed in
+// one translation unit.
+
+typedef struct {
+    unsigned int heap_size;
+    unsigned int used;
+    unsigned int peak_used;
+    unsigned int free_bytes;
+    unsigned int free_blocks;
+    unsigned int largest_free;
+    unsigned int alloc_calls;
+    unsigned int failed_allocs;
+    unsigned int search_steps;
+} heapbench_heap_t;
+
+// Provided by heapbench.c for the glue's screen stand-in
+void host_print(const char* str);
+
+// Provided by kernel_glue.c. Reset starts the frame allocator over on the
+// given page-aligned arena and builds a fresh heap on it.
+void heapbench_reset(unsigned int base, unsigned int frames);
+void heapbench_snapshot(heapbench_heap_t* out);
+void heapbench_print_heap(void);
+
+// The allocator under test (src/mm/memory.c)
+void* kmalloc(unsigned int size);
+void kfree(void* ptr);
+void* krealloc(void* ptr, unsigned int new_size);
+
+#endif // HEAPBENCH_H
@@ -0,0 +1,64 @@
+// Kernel-side half of the hosted heap benchmark. Built with the kernel
+// headers; hands the arena to the real frame allocator (src/mm/pmm.c) and
+// stands in for the screen driver so that src/mm/memory.c links unchanged
+// into a Linux process.
+
+#include "memory.h"
+#include "pmm.h"
+#include "screen.h"
+#include "heapbench.h"
+
+// pmm_init reserves everything below the kernel image; in a Linux process
+// the arena is mapped above the program, so this only covers the binary
+uint8_t kernel_end[1];
+
+// Boot information describing the arena as the only usable memory
+static multiboot_info_t boot_info;
+static multiboot_mmap_entry_t boot_map;
+
+void screen_print(const char* str) {
+    host_print(str);
+}
+
+void screen_println(const char* str) {
+    host_print(str);
+    host_print("\n");
+}
+
+void screen_set_color(uint8_t fg, uint8_t bg) {
+    (void)fg;
+    (void)bg;
+}
+
+void heapbench_reset(unsigned int base, unsigned int frames) {
+    boot_map.size = sizeof(boot_map) - sizeof(boot_map.size);
+    boot_map.addr = base;
+    boot_map.len = (uint64_t)frames * FRAME_SIZE;
+    boot_map.type = MULTIBOOT_MEMORY_AVAILABLE;
+    
+    boot_info.flags = MULTIBOOT_INFO_MEM_MAP;
+    boot_info.mmap_addr = (uint32_t)&boot_map;
+    boot_info.mmap_length = sizeof(boot_map);
+    
+    pmm_init(&boot_info);
+    memory_init();
+}
+
+void heapbench_snapshot(heapbench_heap_t* out) {
+    static heap_stats_t stats;
+    memory_get_stats(&stats);
+
+    out->heap_size = memory_get_total();
+    out->used = memory_get_used();
+    out->peak_used = stats.peak_used;
+    out->free_bytes = stats.free_bytes;
+    out->free_blocks = stats.free_blocks;
+    out->largest_free = stats.largest_free;
+    out->alloc_calls = stats.alloc_calls;
+    out->failed_allocs = stats.failed_allocs;
+    out->search_steps = stats.search_steps;
+}
+
+void heapbench_print_heap(void) {
+    memory_print_heap_stats();
+}
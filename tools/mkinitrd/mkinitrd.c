@@ -0,0 +1,290 @@
+// Packs a directory tree into an initrd image for TRAK-OS. GRUB loads the
+// image as a multiboot module and the kernel reads files straight out of
+// it, so everything the kernel needs to find a file is laid out here:
+//
+//   mkinitrd <dir> <out.img>
+//
+// The image is a header, a hash table over full paths, one entry per file
+// or directory, then the paths and file contents. See src/include/initrd.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Mirrors src/include/initrd.h; its types.h can't be mixed with libc here
+#define INITRD_MAGIC        "TRAKRD01"
+#define INITRD_VERSION      1
+#define INITRD_NONE         0xFFFFFFFFu
+#define FILE_TYPE_REGULAR   1
+#define FILE_TYPE_DIRECTORY 2
+#define MAX_NAME            15          // MAX_FILENAME_LENGTH less the terminator
+#define DATA_ALIGN          16
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int image_size;
+    unsigned int entry_count;
+    unsigned int bucket_count;
+    unsigned int buckets_offset;
+    unsigned int entries_offset;
+} rd_header_t;
+
+typedef struct {
+    unsigned int hash;
+    unsigned int next;
+    unsigned int parent;
+    unsigned int path_offset;
+    unsigned int data_offset;
+    unsigned int size;
+    unsigned short path_length;
+    unsigned short name_start;
+    unsigned char type;
+    unsigned char reserved[3];
+} rd_entry_t;
+
+typedef struct {
+    char* path;                         // Relative to the packed directory
+    char* source;                       // Path on the host
+    unsigned char type;
+    unsigned int size;
+} item_t;
+
+static item_t* items = NULL;
+static unsigned int item_count = 0;
+static unsigned int item_capacity = 0;
+
+static void* xmalloc(size_t size) {
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "mkinitrd: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static char* join(const char* a, const char* b) {
+    char* out = xmalloc(strlen(a) + strlen(b) + 2);
+    sprintf(out, "%s%s%s", a, *a ? "/" : "", b);
+    return out;
+}
+
+// FNV-1a, as the kernel computes it
+static unsigned int hash_path(const char* path, unsigned int length) {
+    unsigned int hash = 2166136261u;
+    for (unsigned int i = 0; i < length; i++) {
+        hash ^= (unsigned char)path[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void add_item(const char* path, const char* source, unsigned char type, unsigned int size) {
+    if (item_count == item_capacity) {
+        item_capacity = item_capacity ? item_capacity * 2 : 64;
+        item_t* grown = realloc(items, item_capacity * sizeof(item_t));
+        if (!grown) {
+            fprintf(stderr, "mkinitrd: out of memory\n");
+            exit(1);
+        }
+        items = grown;
+    }
+    items[item_count].path = join("", path);
+    items[item_count].source = join("", source);
+    items[item_count].type = type;
+    items[item_count].size = size;
+    item_count++;
+}
+
+// Add everything under source, naming it relative to the packed root
+static void scan(const char* source, const char* path) {
+    DIR* dir = opendir(source);
+    if (!dir) {
+        fprintf(stderr, "mkinitrd: can't open directory '%s'\n", source);
+        exit(1);
+    }
+    
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        if (strlen(ent->d_name) > MAX_NAME) {
+            fprintf(stderr, "mkinitrd: name '%s' is longer than %d characters\n", ent->d_name, MAX_NAME);
+            exit(1);
+        }
+        
+        char* child_source = join(source, ent->d_name);
+        char* child_path = join(path, ent->d_name);
+        // Symlinks are skipped rather than followed; a link to a directory
+        // above it would make the scan recurse forever
+        struct stat st;
+        if (lstat(child_source, &st) != 0) {
+            fprintf(stderr, "mkinitrd: can't stat '%s'\n", child_source);
+            exit(1);
+        }
+        if (S_ISLNK(st.st_mode)) {
+            fprintf(stderr, "mkinitrd: skipping symlink '%s'\n", child_source);
+        } else if (S_ISDIR(st.st_mode)) {
+            add_item(child_path, child_source, FILE_TYPE_DIRECTORY, 0);
+            scan(child_source, child_path);
+        } else if (S_ISREG(st.st_mode)) {
+            if (st.st_size >= 0x80000000LL) {
+                fprintf(stderr, "mkinitrd: '%s' is too large\n", child_source);
+                exit(1);
+            }
+            add_item(child_path, child_source, FILE_TYPE_REGULAR, (unsigned int)st.st_size);
+        }
+        free(child_source);
+        free(child_path);
+    }
+    closedir(dir);
+}
+
+static int compare_items(const void* a, const void* b) {
+    return strcmp(((const item_t*)a)->path, ((const item_t*)b)->path);
+}
+
+// Entry index of the directory holding path, found by binary search in the
+// sorted items
+static unsigned int find_parent(const char* path) {
+    const char* slash = strrchr(path, '/');
+    if (!slash) {
+        return INITRD_NONE;
+    }
+    
+    item_t key;
+    key.path = xmalloc(slash - path + 1);
+    memcpy(key.path, path, slash - path);
+    key.path[slash - path] = '\0';
+    item_t* found = bsearch(&key, items, item_count, sizeof(item_t), compare_items);
+    free(key.path);
+    return found ? (unsigned int)(found - items) : INITRD_NONE;
+}
+
+static unsigned int align_up(unsigned long long value) {
+    value = (value + DATA_ALIGN - 1) & ~(unsigned long long)(DATA_ALIGN - 1);
+    if (value >= 0x80000000ULL) {
+        fprintf(stderr, "mkinitrd: image would exceed 2GB\n");
+        exit(1);
+    }
+    return (unsigned int)value;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: mkinitrd <dir> <out.img>\n");
+        return 1;
+    }
+    
+    scan(argv[1], "");
+    qsort(items, item_count, sizeof(item_t), compare_items);
+    
+    // Twice as many buckets as entries keeps chains short
+    unsigned int buckets = 16;
+    while (buckets < item_count * 2) {
+        buckets *= 2;
+    }
+    
+    rd_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INITRD_MAGIC, 8);
+    header.version = INITRD_VERSION;
+    header.entry_count = item_count;
+    header.bucket_count = buckets;
+    header.buckets_offset = sizeof(rd_header_t);
+    header.entries_offset = header.buckets_offset + buckets * sizeof(unsigned int);
+    
+    unsigned int* table = xmalloc(buckets * sizeof(unsigned int));
+    rd_entry_t* entries = xmalloc(item_count * sizeof(rd_entry_t));
+    for (unsigned int i = 0; i < buckets; i++) {
+        table[i] = INITRD_NONE;
+    }
+    
+    // Paths go right after the entries, file data after the paths
+    unsigned long long offset = header.entries_offset + (unsigned long long)item_count * sizeof(rd_entry_t);
+    for (unsigned int i = 0; i < item_count; i++) {
+        rd_entry_t* entry = &entries[i];
+        const char* path = items[i].path;
+        const char* slash = strrchr(path, '/');
+        unsigned int length = strlen(path);
+        memset(entry, 0, sizeof(*entry));
+        entry->hash = hash_path(path, length);
+        entry->parent = find_parent(path);
+        entry->path_offset = (unsigned int)offset;
+        entry->path_length = (unsigned short)length;
+        entry->name_start = slash ? (unsigned short)(slash - path + 1) : 0;
+        entry->type = items[i].type;
+        entry->size = items[i].size;
+        if (length > 0xFFFF) {
+            fprintf(stderr, "mkinitrd: path '%s' is too long\n", path);
+            return 1;
+        }
+        
+        unsigned int bucket = entry->hash & (buckets - 1);
+        entry->next = table[bucket];
+        table[bucket] = i;
+        offset += length;
+    }
+    for (unsigned int i = 0; i < item_count; i++) {
+        offset = align_up(offset);
+        entries[i].data_offset = (unsigned int)offset;
+        offset += entries[i].size;
+    }
+    header.image_size = align_up(offset);
+    
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        fprintf(stderr, "mkinitrd: can't write '%s'\n", argv[2]);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(table, sizeof(unsigned int), buckets, out);
+    fwrite(entries, sizeof(rd_entry_t), item_count, out);
+    unsigned int position = header.entries_offset + item_count * sizeof(rd_entry_t);
+    for (unsigned int i = 0; i < item_count; i++) {
+        fwrite(items[i].path, 1, entries[i].path_length, out);
+        position += entries[i].path_length;
+    }
+    
+    // Copy each file into place, padding up to its data offset
+    static char chunk[65536];
+    unsigned int files = 0;
+    for (unsigned int i = 0; i <= item_count; i++) {
+        unsigned int target = i < item_count ? entries[i].data_offset : header.image_size;
+        for (; position < target; position++) {
+            fputc(0, out);
+        }
+        if (i == item_count || items[i].type != FILE_TYPE_REGULAR) {
+            continue;
+        }
+        
+        FILE* in = fopen(items[i].source, "rb");
+        if (!in) {
+            fprintf(stderr, "mkinitrd: can't read '%s'\n", items[i].source);
+            return 1;
+        }
+        unsigned int left = entries[i].size;
+        while (left > 0) {
+            size_t want = left < sizeof(chunk) ? left : sizeof(chunk);
+            if (fread(chunk, 1, want, in) != want) {
+                fprintf(stderr, "mkinitrd: '%s' changed while packing\n", items[i].source);
+                return 1;
+            }
+            fwrite(chunk, 1, want, out);
+            left -= want;
+        }
+        fclose(in);
+        position += entries[i].size;
+        files++;
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "mkinitrd: can't write '%s'\n", argv[2]);
+        return 1;
+    }
+    
+    printf("mkinitrd: %u files, %u entries, %u bytes\n", files, item_count, header.image_size);
+    return 0;
+}